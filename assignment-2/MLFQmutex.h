@@ -3,89 +3,661 @@
 
 #include "park.h"
 #include "queue.h"
+#include "spinlock.h"
+#include "mlfqStats.h"
+#include "asyncLog.h"
+#include "cacheLine.h"
 #include <iostream>
 #include <string>
 #include <atomic>
 #include "pthread.h"
-#include <unordered_map>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <chrono>
+#include <thread>
+#include <unordered_set>
+#include <sched.h>
 
 using namespace std;
 
+/*
+  Priority level of the owning thread on one MLFQMutex or MLFQSharedMutex
+*/
+struct ThreadLevel {
+  uint64_t mutexId; // Id of the mutex, ids are never reused so a new mutex at the same address starts fresh
+  int level;        // Priority level of this thread on that mutex
+  uint64_t epoch;   // Boost epoch of the mutex when level was computed, a newer epoch resets level to 0
+  shared_ptr<LockStats> stats; // This thread's counters on that mutex, shared with the mutex, may be null
+  long long holdStartNs; // When this thread got the mutex, for locks with several holders at once
+};
+
+/*
+  Entry of a priority queue
+*/
+struct Waiter {
+  ParkSlot* slot;       // Parking slot of the waiting thread
+  long long enqueuedNs; // Time the waiter entered its current level
+  int node;             // NUMA node the thread ran on when it queued, 0 if the cohort policy was off
+};
+
+inline ostream& operator<<(ostream& os, const Waiter& waiter) {
+  return os << waiter.slot;
+}
+
+inline long long steadyNowNs() {
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+  Node currentNumaNode() reports for the calling thread instead of asking the kernel, -1 (the default) to ask
+  Lets tests and samples place threads on made-up nodes on a machine with a single one
+*/
+inline int& numaNodeOverride() {
+  thread_local int node = -1;
+  return node;
+}
+
+/*
+  NUMA node of the CPU the calling thread runs on, 0 if the kernel cannot tell
+  glibc answers getcpu from the vDSO, so this costs no system call
+*/
+inline int currentNumaNode() {
+  if (numaNodeOverride() >= 0) {
+    return numaNodeOverride();
+  }
+  unsigned cpu = 0, node = 0;
+  if (getcpu(&cpu, &node) != 0) {
+    return 0;
+  }
+  return (int)node;
+}
+
+/*
+  Ids of live mutexes, consulted only when a thread sweeps its level records of destroyed mutexes
+*/
+struct MutexRegistry {
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  unordered_set<uint64_t> live;
+};
+
+inline MutexRegistry& mutexRegistry() {
+  static MutexRegistry registry;
+  return registry;
+}
+
+// Level records a thread keeps before dropping those of destroyed mutexes
+static const size_t kLevelSweepSize = 64;
+
+/*
+  Levels of the calling thread on every mutex it used, most recently used first.
+  Freed with the thread, so no shared structure grows with thread churn.
+*/
+struct ThreadLevelTable {
+  vector<ThreadLevel> levels;
+  size_t sweepAt = kLevelSweepSize; // Size at which records of destroyed mutexes are dropped
+
+  // Set once this thread's table is destroyed, e.g. while static mutexes are torn down at exit
+  static bool& gone() {
+    thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  ~ThreadLevelTable() {
+    // Counters stay with their mutex, the blocks can be reused by new threads
+    for (ThreadLevel& record : levels) {
+      if (record.stats) {
+        record.stats->inUse.store(false, memory_order_release);
+      }
+    }
+    gone() = true;
+  }
+};
+
+inline ThreadLevelTable& threadLevels() {
+  thread_local ThreadLevelTable table;
+  return table;
+}
+
+/*
+  Drops the records of mutexes destroyed since the last sweep, along with this thread's counters on them
+*/
+inline void sweepThreadLevels(ThreadLevelTable& table) {
+  MutexRegistry& registry = mutexRegistry();
+  pthread_mutex_lock(&registry.lock);
+  for (size_t i = 0; i < table.levels.size();) {
+    if (registry.live.count(table.levels[i].mutexId) == 0) {
+      table.levels.erase(table.levels.begin() + i);
+    }
+    else {
+      i++;
+    }
+  }
+  pthread_mutex_unlock(&registry.lock);
+  table.sweepAt = 2 * table.levels.size() > kLevelSweepSize ? 2 * table.levels.size() : kLevelSweepSize;
+}
+
+/*
+  Returns the calling thread's record for mutexId, created at level 0 on first use.
+  A record computed before the mutex's current boost epoch falls back to level 0.
+*/
+inline ThreadLevel& findThreadLevel(uint64_t mutexId, uint64_t epoch) {
+  ThreadLevelTable& table = threadLevels();
+  vector<ThreadLevel>& levels = table.levels;
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (levels[i].mutexId == mutexId) {
+      if (i != 0) {
+        swap(levels[i], levels[0]); // Keep the most recently used mutex first
+      }
+      if (levels[0].epoch != epoch) {
+        // A boost happened since this level was computed
+        levels[0].level = 0;
+        levels[0].epoch = epoch;
+      }
+      return levels[0];
+    }
+  }
+  // First use of this mutex by the thread, the only time the registry lock can be taken here
+  if (levels.size() >= table.sweepAt) {
+    sweepThreadLevels(table);
+  }
+  levels.insert(levels.begin(), {mutexId, 0, epoch, nullptr, 0});
+  return levels[0];
+}
+
+/*
+  Returns a new mutex id and registers it as live
+*/
+inline uint64_t nextMutexId() {
+  static atomic<uint64_t> counter(1);
+  uint64_t id = counter.fetch_add(1, memory_order_relaxed);
+  MutexRegistry& registry = mutexRegistry();
+  pthread_mutex_lock(&registry.lock);
+  registry.live.insert(id);
+  pthread_mutex_unlock(&registry.lock);
+  return id;
+}
+
+/*
+  Marks a destroyed mutex's id dead, other threads drop their records of it on their next sweep
+*/
+inline void retireMutexId(uint64_t mutexId) {
+  MutexRegistry& registry = mutexRegistry();
+  pthread_mutex_lock(&registry.lock);
+  registry.live.erase(mutexId);
+  pthread_mutex_unlock(&registry.lock);
+  // The destroying thread drops its own record right away
+  if (ThreadLevelTable::gone()) {
+    return;
+  }
+  vector<ThreadLevel>& levels = threadLevels().levels;
+  for (size_t i = 0; i < levels.size(); i++) {
+    if (levels[i].mutexId == mutexId) {
+      levels.erase(levels.begin() + i);
+      break;
+    }
+  }
+}
+
+/*
+  Two-level bitmap of non-empty priority levels, the highest priority waiting level is found with two count-trailing-zeros
+*/
+class LevelBitmap {
+private:
+  uint64_t summary;       // Bit i is set if words[i] has any bit set
+  vector<uint64_t> words; // Bit j of words[i] is set if level 64 * i + j has waiters
+
+public:
+  static const int kMaxLevels = 64 * 64;
+
+  /*
+    Returns numLevels if a bitmap can hold it, throws otherwise
+    Mutexes call it from their initializer list, before anything is allocated
+  */
+  static int checkLevels(int numLevels) {
+    if (numLevels <= 0 || numLevels > kMaxLevels) {
+      throw invalid_argument("Number of priority levels must be between 1 and 4096.");
+    }
+    return numLevels;
+  }
+
+  LevelBitmap(int numLevels) : summary(0), words(numLevels > 0 ? (numLevels + 63) / 64 : 0, 0) {}
+
+  void set(int level) {
+    words[level >> 6] |= 1ULL << (level & 63);
+    summary |= 1ULL << (level >> 6);
+  }
+
+  void clear(int level) {
+    words[level >> 6] &= ~(1ULL << (level & 63));
+    if (words[level >> 6] == 0) {
+      summary &= ~(1ULL << (level >> 6));
+    }
+  }
+
+  /*
+    Returns the smallest set level, -1 if none
+  */
+  int first() const {
+    if (summary == 0) {
+      return -1;
+    }
+    int word = countr_zero(summary);
+    return (word << 6) | countr_zero(words[word]);
+  }
+
+  /*
+    Returns the smallest set level greater than level, -1 if none
+  */
+  int next(int level) const {
+    level++;
+    int word = level >> 6;
+    if (word >= (int)words.size()) {
+      return -1;
+    }
+    uint64_t rest = (level & 63) == 0 ? words[word] : words[word] & (~0ULL << (level & 63));
+    if (rest != 0) {
+      return (word << 6) | countr_zero(rest);
+    }
+    uint64_t higher = word + 1 >= 64 ? 0 : summary & (~0ULL << (word + 1));
+    if (higher == 0) {
+      return -1;
+    }
+    word = countr_zero(higher);
+    return (word << 6) | countr_zero(words[word]);
+  }
+};
+
 class MLFQMutex {
 
 private:
-  int flag; // Lock flag 
-  atomic_flag guard = ATOMIC_FLAG_INIT; // Atomic flag to synchronize lock() and unlock() bodies
-  double qVal; // Quantum (time slice) value 
-  vector<Queue<pthread_t>*> queueList; // List of queues from priority 0 (max priority) to numPriorityLevels (min priority)
-  Garage* garage; // Associated object to call park, unpark and setPark to put threads to sleep
-  unordered_map<pthread_t, int> threadLevelMap; // Maps thread_id to priorityLevel
-  chrono::high_resolution_clock::time_point ts_start; // Stores start timestamp 
+  // Every lock() and unlock() swaps itself into the guard's tail, spinners poll flag, and the holder updates its
+  // own bookkeeping, so each of these groups gets its own cache line and the groups do not invalidate each other
+
+  MCSLock guard; // Queue spinlock to synchronize lock() and unlock() bodies
+
+  alignas(kCacheLineSize) atomic<int> flag; // Lock flag, read without the guard by spinning threads
+  atomic<long long> spinBudgetNs; // Learned time to spin before queueing, derived from avgHoldNs and spinShift
+  atomic<int> spinShift; // Halvings applied to the budget, one per spin the holder outlasted, one undone per successful spin
+
+  alignas(kCacheLineSize) chrono::high_resolution_clock::time_point ts_start; // Stores start timestamp 
   chrono::high_resolution_clock::time_point ts_end; // Stores end timestamp
+  atomic<long long> avgHoldNs; // Moving average of critical section execution time
+  long long handoffNs; // Time of the last unpark() by unlock(), read by the woken thread
 
+  // Only accessed while holding the guard
+  alignas(kCacheLineSize) LevelBitmap nonEmptyLevels; // Levels whose queue has waiters
+  long long boostIntervalNs; // Period of the priority boost, 0 disables boosting
+  long long agingThresholdNs; // Wait after which a queued thread moves up one level, 0 disables aging
+  long long lastBoostNs; // Time of the last priority boost
+  uint64_t boosts; // Number of boosts
+  int cohortHandoffs; // Handoffs in a row that skipped ahead to a same-node waiter
 
-public:
-  MLFQMutex(int numPLevels, double quantumValue) : qVal(quantumValue), garage(new Garage()), flag(0) {
-    queueList = vector<Queue<pthread_t>*>(numPLevels);
-    for (int i = 0; i < queueList.size(); i++) {
-      Queue<pthread_t>* q = new Queue<pthread_t>();
-      queueList[i] = q;
+  // Read on every call, written rarely
+  alignas(kCacheLineSize) double qVal; // Quantum (time slice) value 
+  vector<Queue<Waiter>*> queueList; // List of queues from priority 0 (max priority) to numPriorityLevels (min priority)
+  Garage* garage; // Associated object to call park, unpark and setPark to put threads to sleep
+  uint64_t id; // Key of this mutex in the thread-local level records
+  long long maxSpinNs; // Upper bound for the spin phase of lock(), 0 disables spinning
+  atomic<uint64_t> boostEpoch; // Incremented by every boost, invalidates the thread-local levels
+  atomic<LockTrace*> trace; // Event ring, nullptr unless tracing is enabled
+  atomic<bool> verbose; // Whether lock() logs threads it queues
+  atomic<int> cohortLimit; // Consecutive handoffs that may prefer a waiter on the releasing thread's node, 0 disables it
+  pthread_mutex_t statsLock; // Protects statsBlocks, only taken the first time a thread uses this mutex
+  vector<shared_ptr<LockStats>> statsBlocks; // Per-thread counters, summed by stats()
+
+  /*
+    Returns the calling thread's level record for this mutex, created at level 0 on first use
+  */
+  ThreadLevel& threadLevel() {
+    ThreadLevel& record = findThreadLevel(id, boostEpoch.load(memory_order_relaxed));
+    if (!record.stats) {
+      record.stats = acquireStats();
     }
+    return record;
   }
 
-  void lock() {
-    while (guard.test_and_set(memory_order_acquire))
-      ; // acquire guard lock by spinning
+  /*
+    Hands a counter block to a thread using this mutex for the first time, reusing blocks of exited threads
+  */
+  shared_ptr<LockStats> acquireStats() {
+    pthread_mutex_lock(&statsLock);
+    for (shared_ptr<LockStats>& block : statsBlocks) {
+      bool expected = false;
+      if (block->inUse.compare_exchange_strong(expected, true, memory_order_acquire)) {
+        pthread_mutex_unlock(&statsLock);
+        return block;
+      }
+    }
+    shared_ptr<LockStats> block = make_shared<LockStats>((int)queueList.size());
+    statsBlocks.push_back(block);
+    pthread_mutex_unlock(&statsLock);
+    return block;
+  }
 
-    if (flag == 0) {
-      flag = 1; // lock is acquired
+  void traceEvent(TraceEventType type, int level, long long ns, long long durNs = 0) {
+    LockTrace* t = trace.load(memory_order_acquire);
+    if (t != nullptr) {
+      t->record(type, level, ns, durNs);
+    }
+  }
+
+  /*
+    Moves every waiter to level 0 keeping their priority order, and resets the level of every thread (MLFQ rule 5)
+    Called while holding the guard
+  */
+  void boost(long long now) {
+    for (int level = nonEmptyLevels.next(0); level >= 0; level = nonEmptyLevels.next(level)) {
+      while (!queueList[level]->isEmpty()) {
+        Waiter w = queueList[level]->dequeue();
+        w.enqueuedNs = now;
+        queueList[0]->enqueue(w);
+        nonEmptyLevels.set(0);
+      }
+      nonEmptyLevels.clear(level);
+    }
+    boostEpoch.fetch_add(1, memory_order_relaxed);
+    lastBoostNs = now;
+    boosts++;
+    traceEvent(kTraceBoost, 0, now);
+  }
+
+  /*
+    Moves queue heads that waited longer than the aging threshold up one level
+    Called while holding the guard
+  */
+  void age(long long now) {
+    for (int level = nonEmptyLevels.next(0); level >= 0; level = nonEmptyLevels.next(level)) {
+      Waiter w;
+      while (queueList[level]->front(w) && now - w.enqueuedNs >= agingThresholdNs) {
+        queueList[level]->dequeue();
+        w.enqueuedNs = now;
+        queueList[level - 1]->enqueue(w);
+        nonEmptyLevels.set(level - 1);
+      }
+      if (queueList[level]->isEmpty()) {
+        nonEmptyLevels.clear(level);
+      }
+    }
+  }
+
+  /*
+    Takes the lock if it is free, used by spinning threads
+  */
+  bool tryAcquire() {
+    MCSLock::Node guardNode;
+    guard.lock(guardNode); // acquire guard lock, spinning on our own node
+
+    bool acquired = flag.load(memory_order_relaxed) == 0;
+    if (acquired) {
+      flag.store(1, memory_order_relaxed);
+      ts_start = chrono::high_resolution_clock::now();
+    }
+    guard.unlock(guardNode);
+    return acquired;
+  }
+
+  static const int kMaxSpinShift = 8; // Repeated failures shrink the budget to 1/256 at most
+
+  /*
+    Spins with exponential backoff for up to the learned budget, waiting for the holder to release the lock.
+    A released lock only ever has an empty queue, so spinning threads never overtake queued ones.
+    Stops at timeout too if it comes first, timeout is nullptr for lock()
+  */
+  bool spinAcquire(long long& spunNs, const chrono::steady_clock::time_point* timeout) {
+    long long budget = spinBudgetNs.load(memory_order_relaxed);
+    if (budget <= 0) {
+      return false;
+    }
+    long long begin = steadyNowNs();
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::nanoseconds(budget);
+    if (timeout != nullptr && *timeout < deadline) {
+      deadline = *timeout;
+    }
+    int backoff = 1;
+    while (true) {
+      if (flag.load(memory_order_relaxed) == 0 && tryAcquire()) {
+        spunNs = steadyNowNs() - begin;
+        // Spinning paid off, give back one halving
+        int shift = spinShift.load(memory_order_relaxed);
+        if (shift > 0) {
+          spinShift.store(shift - 1, memory_order_relaxed);
+        }
+        return true;
+      }
+      if (chrono::steady_clock::now() >= deadline) {
+        break;
+      }
+      for (int i = 0; i < backoff; i++) {
+        cpuRelax();
+      }
+      if (backoff < 1024) {
+        backoff <<= 1;
+      }
+    }
+    // Holder outlasted the budget, spin less next time, unlock() keeps the halving when it learns a new hold time
+    // A timeout cut short says nothing about the holder
+    if (timeout == nullptr || deadline != *timeout) {
+      int shift = spinShift.load(memory_order_relaxed);
+      if (shift < kMaxSpinShift) {
+        spinShift.store(shift + 1, memory_order_relaxed);
+      }
+      spinBudgetNs.store(budget / 2, memory_order_relaxed);
+    }
+    spunNs = steadyNowNs() - begin;
+    return false;
+  }
+
+  /*
+    Body of lock() and the timed variants, waits without limit if deadline is nullptr
+    Returns false if the deadline passed before the lock was handed to this thread
+  */
+  bool acquire(const chrono::steady_clock::time_point* deadline) {
+    // Look up this thread's level before taking the guard, it is thread-local and needs no synchronization
+    ThreadLevel& record = threadLevel();
+    int priorityLevel = record.level;
+
+    // Short critical sections are cheaper to wait out than to sleep through
+    long long spunNs = 0;
+    if (spinAcquire(spunNs, deadline)) {
+      record.stats->recordAcquire(priorityLevel, spunNs, true);
+      traceEvent(kTraceWait, priorityLevel, steadyNowNs() - spunNs, spunNs);
+      return true;
+    }
+
+    // Look up the node before taking the guard, and only when the cohort policy is on
+    int node = cohortLimit.load(memory_order_relaxed) > 0 ? currentNumaNode() : 0;
+
+    MCSLock::Node guardNode;
+    guard.lock(guardNode); // acquire guard lock, spinning on our own node
+
+    if (flag.load(memory_order_relaxed) == 0) {
+      flag.store(1, memory_order_relaxed); // lock is acquired
       ts_start = chrono::high_resolution_clock::now(); // Take timestamp after acquiring lock
-      guard.clear(memory_order_release);
+      guard.unlock(guardNode);
+      record.stats->recordAcquire(priorityLevel, spunNs, spunNs > 0);
     }
     else {
       pthread_t t_id = pthread_self();
-      int priorityLevel = 0;
-      // If thread id is not in the map, add it to the map with value 0
-      // Else, grab the existing value
-      if (threadLevelMap.find(t_id) == threadLevelMap.end()) {
-        threadLevelMap[t_id] = priorityLevel;
-      }
-      else {
-        priorityLevel = threadLevelMap[t_id];
-      }
-      // Add t_id to the queue located at the priority level
-      cout << "Adding thread with ID: " << t_id << " to level " << priorityLevel << endl;
-      cout.flush();
-      queueList[priorityLevel]->enqueue(t_id);
+      long long waitStart = steadyNowNs() - spunNs;
+      // A boost may have happened since the level was read
+      if (priorityLevel != 0 && record.epoch != boostEpoch.load(memory_order_relaxed)) {
+        priorityLevel = threadLevel().level;
+      }
+      // Add this thread's parking slot to the queue located at the priority level
+      queueList[priorityLevel]->enqueue({Garage::self(), steadyNowNs(), node});
+      nonEmptyLevels.set(priorityLevel);
+      traceEvent(kTraceEnqueue, priorityLevel, steadyNowNs());
       // Signal that this thread will park to prevent signal loss
       garage->setPark();
       // Release guard lock
-      guard.clear(memory_order_release);
+      guard.unlock(guardNode);
+      // Hand the message to the background writer instead of writing to stdout here
+      if (verbose.load(memory_order_relaxed)) {
+        AsyncLog::instance().log((unsigned long)t_id, priorityLevel);
+      }
       // Park this thread
-      garage->park();
+      if (deadline == nullptr) {
+        garage->park();
+      }
+      else if (!garage->parkUntil(*deadline) && cancelWait()) {
+        record.stats->recordTimeout();
+        return false;
+      }
       // Take timestamp right after being dequeued from the sleep queue and unparked (woken up)
       ts_start = chrono::high_resolution_clock::now();
+      // The lock is ours now, so handoffNs is stable until we unlock
+      long long now = steadyNowNs();
+      record.stats->recordAcquire(priorityLevel, now - waitStart, true);
+      record.stats->recordHandoff(now - handoffNs);
+      traceEvent(kTraceWait, priorityLevel, waitStart, now - waitStart);
     }
+    return true;
   }
 
-  void unlock() {
-    while (guard.test_and_set(memory_order_acquire))
-      ; // acquire guard lock by spinning
+  /*
+    Removes the waiter that gets the lock next from the highest priority non-empty level
+    With a cohort limit the first waiter on the releasing thread's node is preferred over the head,
+    but only cohortLimit times in a row so waiters on other nodes still get the lock.
+    Called while holding the guard
+  */
+  Waiter nextWaiter(int level, int node) {
+    Queue<Waiter>* q = queueList[level];
+    Waiter next;
+    int limit = cohortLimit.load(memory_order_relaxed);
+    if (limit > 0 && cohortHandoffs < limit) {
+      bool skipped = false; // Whether waiters on other nodes were passed over
+      bool sameNode = q->removeIf([&next, &skipped, node](const Waiter& w) {
+        if (w.node != node) {
+          skipped = true;
+          return false;
+        }
+        next = w;
+        return true;
+      });
+      if (sameNode) {
+        // A same-node head is plain FIFO order, it ends the run instead of counting against the limit
+        cohortHandoffs = skipped ? cohortHandoffs + 1 : 0;
+        return next;
+      }
+    }
+    cohortHandoffs = 0;
+    return q->dequeue();
+  }
+
+  /*
+    Takes the calling thread out of whichever level queue it is in after a timed out park
+    Returns false if unlock() dequeued it first, the lock is then already handed to it
+  */
+  bool cancelWait() {
+    ParkSlot* self = Garage::self();
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    bool removed = false;
+    // Boosting and aging may have moved the waiter to another level
+    for (int level = nonEmptyLevels.first(); level >= 0 && !removed; level = nonEmptyLevels.next(level)) {
+      removed = queueList[level]->removeIf([self](const Waiter& w) { return w.slot == self; });
+      if (removed && queueList[level]->isEmpty()) {
+        nonEmptyLevels.clear(level);
+      }
+    }
+    if (removed) {
+      garage->cancelPark();
+    }
+    guard.unlock(guardNode);
+    return removed;
+  }
+
+
+public:
+  MLFQMutex(int numPLevels, double quantumValue, double maxSpinTime = 50e-6) : flag(0), spinBudgetNs(0), spinShift(0), avgHoldNs(0), handoffNs(0),
+    nonEmptyLevels(LevelBitmap::checkLevels(numPLevels)), boostIntervalNs(0), agingThresholdNs(0), lastBoostNs(steadyNowNs()), boosts(0), cohortHandoffs(0),
+    qVal(quantumValue), garage(new Garage()), id(nextMutexId()), maxSpinNs((long long)(maxSpinTime * 1e9)), boostEpoch(0),
+    trace(nullptr), verbose(true), cohortLimit(0) {
+    // Spinning only pays off when the holder can run on another core at the same time
+    if (thread::hardware_concurrency() <= 1) {
+      maxSpinNs = 0;
+    }
+    pthread_mutex_init(&statsLock, nullptr);
+    queueList = vector<Queue<Waiter>*>(numPLevels);
+    for (int i = 0; i < queueList.size(); i++) {
+      Queue<Waiter>* q = new Queue<Waiter>();
+      queueList[i] = q;
+    }
+  }
+
+  /*
+    Call only once no thread holds or waits for the lock
+  */
+  ~MLFQMutex() {
+    retireMutexId(id);
+    for (Queue<Waiter>* q : queueList) {
+      delete q;
+    }
+    delete garage;
+    delete trace.load(memory_order_acquire);
+    pthread_mutex_destroy(&statsLock);
+  }
+
+  MLFQMutex(const MLFQMutex&) = delete;
+  MLFQMutex& operator=(const MLFQMutex&) = delete;
+
+  void lock() {
+    acquire(nullptr);
+  }
+
+  /*
+    Takes the lock only if it is free, never queues
+  */
+  bool try_lock() {
+    ThreadLevel& record = threadLevel();
+    if (flag.load(memory_order_relaxed) != 0 || !tryAcquire()) {
+      return false;
+    }
+    record.stats->recordAcquire(record.level, 0, false);
+    return true;
+  }
+
+  /*
+    Waits at most timeout for the lock, returns false if it did not get it
+  */
+  template<class Rep, class Period>
+  bool try_lock_for(const chrono::duration<Rep, Period>& timeout) {
+    return try_lock_until(chrono::steady_clock::now() + timeout);
+  }
+
+  /*
+    Waits until timeout for the lock, returns false if it did not get it
+  */
+  template<class Clock, class Duration>
+  bool try_lock_until(const chrono::time_point<Clock, Duration>& timeout) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(timeout - Clock::now());
+    return acquire(&deadline);
+  }
 
+  void unlock() {
+    // Only the holder touches the timestamps and its own level, so the demotion is computed before taking the guard
     ts_end = chrono::high_resolution_clock::now(); // Take timestamp right before giving back lock 
     double exec_time = chrono::duration_cast<chrono::duration<double>>(ts_end - ts_start).count(); // Calculate critical section execution time
-    pthread_t t_id = pthread_self();
 
-    int previousPriorityLevel = 0;
-
-    // Update previous priority level with stored value if it exists
-    bool tidInMap = threadLevelMap.find(t_id) != threadLevelMap.end();
-    if (tidInMap) {
-      previousPriorityLevel = threadLevelMap[t_id];
+    // Learn the spin budget from recent hold times, spinning is pointless if the lock is usually held longer than maxSpinNs
+    // Spins the holder outlasted keep it smaller through spinShift
+    long long holdNs = (long long)(exec_time * 1e9);
+    long long avg = (avgHoldNs.load(memory_order_relaxed) * 7 + holdNs) / 8;
+    avgHoldNs.store(avg, memory_order_relaxed);
+    long long budget = 2 * avg <= maxSpinNs ? (2 * avg) >> spinShift.load(memory_order_relaxed) : 0;
+    // Spinners read the budget from the flag's line, leave it untouched when it does not change
+    if (spinBudgetNs.load(memory_order_relaxed) != budget) {
+      spinBudgetNs.store(budget, memory_order_relaxed);
     }
 
+    ThreadLevel& record = threadLevel();
+    int& priorityLevel = record.level;
+    int previousPriorityLevel = priorityLevel;
+
     // If critical section execution time is bigger than quantum value, 
     // increase priorityLevel value (which decreases actual priority) by floor(execution time/quantum value)
     // however, the new priority level cannot be higher than the lowest available priority level 
@@ -93,32 +665,137 @@ public:
       int newPriorityLevel = previousPriorityLevel + (int)(exec_time / qVal);
       int lowestPriorityLevel = queueList.size() - 1;
       // Update priority level for next runs
-      threadLevelMap[t_id] = newPriorityLevel > lowestPriorityLevel ? lowestPriorityLevel : newPriorityLevel;
+      priorityLevel = newPriorityLevel > lowestPriorityLevel ? lowestPriorityLevel : newPriorityLevel;
+    }
+    record.stats->recordHold(previousPriorityLevel, holdNs, priorityLevel > previousPriorityLevel);
+    if (trace.load(memory_order_relaxed) != nullptr) {
+      long long now = steadyNowNs();
+      traceEvent(kTraceHold, previousPriorityLevel, now - holdNs, holdNs);
+      if (priorityLevel > previousPriorityLevel) {
+        traceEvent(kTraceDemote, priorityLevel, now);
+      }
     }
 
-    // Find next sleeping thread to run
-    pthread_t next;
-    bool noSleepingThreads = true;
-    // Go through the queues by priority (0, 1, ..., pMin)
-    for (int i = 0; i < queueList.size(); i++) {
-      // Check if queue with priority i is empty
-      // If it is, continue checking
-      // If it is not, dequeue from the queue, found the next thread to run
-      if (!queueList[i]->isEmpty()) {
-        next = queueList[i]->dequeue();
-        noSleepingThreads = false;
-        break;
+    // Look up the node before taking the guard, and only when the cohort policy is on
+    int node = cohortLimit.load(memory_order_relaxed) > 0 ? currentNumaNode() : 0;
+
+    MCSLock::Node guardNode;
+    guard.lock(guardNode); // acquire guard lock, spinning on our own node
+
+    // Periodically give every thread its top priority back, and lift waiters that waited too long
+    if (boostIntervalNs > 0 || agingThresholdNs > 0) {
+      long long now = steadyNowNs();
+      if (boostIntervalNs > 0 && now - lastBoostNs >= boostIntervalNs) {
+        boost(now);
+      }
+      else if (agingThresholdNs > 0) {
+        age(now);
+      }
+    }
+
+    // Find next sleeping thread to run, the bitmap gives the highest priority level with waiters
+    ParkSlot* next;
+    int nextLevel = nonEmptyLevels.first();
+    bool noSleepingThreads = nextLevel < 0;
+    if (!noSleepingThreads) {
+      next = nextWaiter(nextLevel, node).slot;
+      if (queueList[nextLevel]->isEmpty()) {
+        nonEmptyLevels.clear(nextLevel);
       }
     }
 
     if (noSleepingThreads) {
-      flag = 0; // let go of the lock, no sleeping threads 
+      flag.store(0, memory_order_relaxed); // let go of the lock, no sleeping threads 
     }
     else {
+      handoffNs = steadyNowNs();
+      traceEvent(kTraceHandoff, nextLevel, handoffNs);
       garage->unpark(next); // wake up the next thread in the queue and keep holding the lock for it
     }
 
-    guard.clear(memory_order_release);
+    guard.unlock(guardNode);
+  }
+
+  /*
+    Every interval seconds all threads get back to the highest priority level, 0 disables boosting
+  */
+  void setBoostInterval(double interval) {
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    boostIntervalNs = (long long)(interval * 1e9);
+    lastBoostNs = steadyNowNs();
+    guard.unlock(guardNode);
+  }
+
+  /*
+    A thread waiting for threshold seconds at one level moves up a level, 0 disables aging
+  */
+  void setAgingThreshold(double threshold) {
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    agingThresholdNs = (long long)(threshold * 1e9);
+    guard.unlock(guardNode);
+  }
+
+  /*
+    Lets unlock() hand the lock to a waiter on its own NUMA node ahead of the queue head, at most maxConsecutive
+    times in a row, keeping the protected data in that node's caches. Priority levels are still respected,
+    only waiters of the highest non-empty level are considered. 0 (the default) keeps strict FIFO order.
+  */
+  void setNumaCohort(int maxConsecutive) {
+    if (maxConsecutive < 0) {
+      throw invalid_argument("Cohort limit must not be negative.");
+    }
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    cohortLimit.store(maxConsecutive, memory_order_relaxed);
+    cohortHandoffs = 0;
+    guard.unlock(guardNode);
+  }
+
+  /*
+    Turns the "Adding thread" messages of lock() on or off, they are written asynchronously when on
+  */
+  void setVerbose(bool on) {
+    verbose.store(on, memory_order_relaxed);
+  }
+
+  /*
+    Sums the counters of every thread that used this mutex, safe to call at any time
+  */
+  MLFQStats stats() {
+    MLFQStats total((int)queueList.size());
+    pthread_mutex_lock(&statsLock);
+    for (shared_ptr<LockStats>& block : statsBlocks) {
+      total.add(*block);
+    }
+    pthread_mutex_unlock(&statsLock);
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    total.boosts = boosts;
+    guard.unlock(guardNode);
+    return total;
+  }
+
+  /*
+    Starts recording the last capacity lock events, see exportChromeTrace()
+  */
+  void enableTrace(size_t capacity) {
+    LockTrace* expected = nullptr;
+    LockTrace* t = new LockTrace(capacity);
+    if (!trace.compare_exchange_strong(expected, t, memory_order_release)) {
+      delete t; // Already enabled
+    }
+  }
+
+  /*
+    Writes recorded events as Chrome trace JSON, call while no thread uses the lock
+  */
+  void exportChromeTrace(ostream& os) {
+    LockTrace* t = trace.load(memory_order_acquire);
+    if (t != nullptr) {
+      t->exportChromeTrace(os);
+    }
   }
 
   /*
@@ -0,0 +1,208 @@
+#ifndef MLFQSHAREDMUTEX_H
+#define MLFQSHAREDMUTEX_H
+
+#include "MLFQmutex.h"
+
+using namespace std;
+
+/*
+  Entry of a priority queue of MLFQSharedMutex
+*/
+struct SharedWaiter {
+  ParkSlot* slot; // Parking slot of the waiting thread
+  bool writer;    // Waits for exclusive ownership
+};
+
+inline ostream& operator<<(ostream& os, const SharedWaiter& waiter) {
+  return os << waiter.slot << (waiter.writer ? "(w)" : "(r)");
+}
+
+/*
+  Reader-writer variant of MLFQMutex
+  Readers and writers share the priority queues and are demoted by their own hold times.
+  When the lock becomes free, the head of the highest priority queue gets it. If the head is a reader,
+  every reader directly behind it is admitted with it as one batch, continuing into lower levels
+  until the first queued writer.
+*/
+class MLFQSharedMutex {
+
+private:
+  MCSLock guard; // Queue spinlock to synchronize the bodies of all lock and unlock methods
+  double qVal; // Quantum (time slice) value
+  bool preferWriters; // New readers queue behind waiting writers instead of joining active readers
+  int readers; // Number of threads holding the lock in shared mode
+  bool writer; // Whether a thread holds the lock exclusively
+  int waitingWriters; // Number of queued writers
+  vector<Queue<SharedWaiter>*> queueList; // List of queues from priority 0 (max priority) to numPriorityLevels (min priority)
+  LevelBitmap nonEmptyLevels; // Levels whose queue has waiters
+  Garage* garage; // Associated object to call park, unpark and setPark to put threads to sleep
+  uint64_t id; // Key of this mutex in the thread-local level records
+
+  /*
+    Queues the calling thread and parks it, the thread owns the lock when this returns
+    Called while holding the guard, releases it
+  */
+  void wait(MCSLock::Node& guardNode, int priorityLevel, bool isWriter) {
+    queueList[priorityLevel]->enqueue({Garage::self(), isWriter});
+    nonEmptyLevels.set(priorityLevel);
+    if (isWriter) {
+      waitingWriters++;
+    }
+    garage->setPark();
+    guard.unlock(guardNode);
+    garage->park();
+  }
+
+  /*
+    Passes the free lock to the head of the highest priority queue, with the readers right behind it if it is a reader
+    Called while holding the guard
+  */
+  void handoff() {
+    int level = nonEmptyLevels.first();
+    if (level < 0) {
+      return;
+    }
+    SharedWaiter next;
+    queueList[level]->front(next);
+    if (next.writer) {
+      queueList[level]->dequeue();
+      writer = true;
+      waitingWriters--;
+      if (queueList[level]->isEmpty()) {
+        nonEmptyLevels.clear(level);
+      }
+      garage->unpark(next.slot);
+      return;
+    }
+    // Admit readers as one batch in priority order, stopping at the first writer
+    while (level >= 0) {
+      Queue<SharedWaiter>* q = queueList[level];
+      while (q->front(next) && !next.writer) {
+        q->dequeue();
+        readers++;
+        garage->unpark(next.slot);
+      }
+      if (!q->isEmpty()) {
+        break;
+      }
+      nonEmptyLevels.clear(level);
+      level = nonEmptyLevels.next(level);
+    }
+  }
+
+  /*
+    Records when the calling thread got the lock
+  */
+  void started(ThreadLevel& record) {
+    record.holdStartNs = steadyNowNs();
+  }
+
+  /*
+    Demotes the calling thread by floor(execution time/quantum value) levels if it held the lock longer than the quantum
+  */
+  void finished() {
+    ThreadLevel& record = findThreadLevel(id, 0);
+    double exec_time = (steadyNowNs() - record.holdStartNs) / 1e9;
+    if (exec_time > qVal) {
+      int newPriorityLevel = record.level + (int)(exec_time / qVal);
+      int lowestPriorityLevel = queueList.size() - 1;
+      record.level = newPriorityLevel > lowestPriorityLevel ? lowestPriorityLevel : newPriorityLevel;
+    }
+  }
+
+
+public:
+  MLFQSharedMutex(int numPLevels, double quantumValue, bool writerPreference = true) : qVal(quantumValue),
+    preferWriters(writerPreference), readers(0), writer(false), waitingWriters(0), nonEmptyLevels(LevelBitmap::checkLevels(numPLevels)),
+    garage(new Garage()), id(nextMutexId()) {
+    queueList = vector<Queue<SharedWaiter>*>(numPLevels);
+    for (int i = 0; i < queueList.size(); i++) {
+      queueList[i] = new Queue<SharedWaiter>();
+    }
+  }
+
+  /*
+    Call only once no thread holds or waits for the lock
+  */
+  ~MLFQSharedMutex() {
+    retireMutexId(id);
+    for (Queue<SharedWaiter>* q : queueList) {
+      delete q;
+    }
+    delete garage;
+  }
+
+  MLFQSharedMutex(const MLFQSharedMutex&) = delete;
+  MLFQSharedMutex& operator=(const MLFQSharedMutex&) = delete;
+
+  /*
+    Acquires the lock exclusively
+  */
+  void lock() {
+    ThreadLevel& record = findThreadLevel(id, 0);
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    if (!writer && readers == 0 && nonEmptyLevels.first() < 0) {
+      writer = true;
+      guard.unlock(guardNode);
+    }
+    else {
+      wait(guardNode, record.level, true);
+    }
+    started(record);
+  }
+
+  void unlock() {
+    finished();
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    writer = false;
+    handoff();
+    guard.unlock(guardNode);
+  }
+
+  /*
+    Acquires the lock in shared mode, joining the active readers unless a writer holds the lock
+    or, with writer preference, a writer is waiting
+  */
+  void lock_shared() {
+    ThreadLevel& record = findThreadLevel(id, 0);
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    // Without a writer in the way nothing is queued ahead of this reader, handoff() admits every reader that is not behind a writer
+    if (!writer && (!preferWriters || waitingWriters == 0)) {
+      readers++;
+      guard.unlock(guardNode);
+    }
+    else {
+      wait(guardNode, record.level, false);
+    }
+    started(record);
+  }
+
+  void unlock_shared() {
+    finished();
+    MCSLock::Node guardNode;
+    guard.lock(guardNode);
+    readers--;
+    if (readers == 0) {
+      handoff();
+    }
+    guard.unlock(guardNode);
+  }
+
+  /*
+    Calls print() on each queue
+  */
+  void print() {
+    cout << "Waiting threads:\n";
+    for (int i = 0; i < queueList.size(); i++) {
+      cout << "Level " << i << ":";
+      queueList[i]->print();
+    }
+  }
+
+
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include "cacheLine.h"
+#include "pthread.h"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sched.h>
+#include <thread>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/*
+  Background consumer of fixed-size records, threads append to their own lock-free ring and a drainer
+  thread hands every record to consume, then calls endPass once per pass that consumed any.
+  The drainer is started by the first record and sleeps on a futex while the rings are empty,
+  so a process that never logs pays nothing. Rings are per thread and per Record type, so keep
+  one recorder per Record type (the loggers below are singletons).
+*/
+template<typename Record>
+class AsyncRecorder {
+private:
+  /*
+    Single producer (owning thread), single consumer (drainer) ring
+  */
+  struct ThreadBuffer {
+    static const uint64_t kCapacity = 1024;
+    Record records[kCapacity];
+    alignas(kCacheLineSize) atomic<uint64_t> head{0}; // Next slot the owner writes
+    alignas(kCacheLineSize) atomic<uint64_t> tail{0}; // Next slot the drainer reads
+    atomic<bool> orphaned{false};         // Owner exited, removed once drained
+  };
+
+  struct Handle {
+    shared_ptr<ThreadBuffer> buffer;
+
+    ~Handle() {
+      if (buffer) {
+        buffer->orphaned.store(true, memory_order_release);
+      }
+    }
+  };
+
+  function<void(const Record&)> consume;
+  function<void()> endPass;
+  pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER; // Protects buffers and started, taken once per thread and by the drainer
+  vector<shared_ptr<ThreadBuffer>> buffers;
+  alignas(kCacheLineSize) atomic<uint32_t> sleeping{0}; // 1 while the drainer is parked or about to park
+  atomic<uint32_t> passes{0};         // drain passes done, flush waiters sleep on it
+  atomic<uint32_t> passWaiters{0};    // threads sleeping on passes
+  atomic<bool> stopping{false};
+  bool started = false;
+  thread drainer;
+
+  static long futex(atomic<uint32_t>* addr, int op, uint32_t val) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, nullptr, nullptr, 0);
+  }
+
+  ThreadBuffer& threadBuffer() {
+    thread_local Handle handle;
+    if (!handle.buffer) {
+      handle.buffer = make_shared<ThreadBuffer>();
+      pthread_mutex_lock(&buffersLock);
+      buffers.push_back(handle.buffer);
+      if (!started && !stopping.load(memory_order_relaxed)) {
+        started = true;
+        drainer = thread(&AsyncRecorder::run, this);
+      }
+      pthread_mutex_unlock(&buffersLock);
+    }
+    return *handle.buffer;
+  }
+
+  void wakeDrainer() {
+    if (sleeping.exchange(0, memory_order_seq_cst) == 1) {
+      futex(&sleeping, FUTEX_WAKE_PRIVATE, 1);
+    }
+  }
+
+  bool anyPending() {
+    pthread_mutex_lock(&buffersLock);
+    bool pending = false;
+    for (shared_ptr<ThreadBuffer>& b : buffers) {
+      if (b->tail.load(memory_order_relaxed) != b->head.load(memory_order_acquire)) {
+        pending = true;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&buffersLock);
+    return pending;
+  }
+
+  /*
+    Consumes everything currently in the rings, returns the number of records consumed
+  */
+  size_t drain() {
+    pthread_mutex_lock(&buffersLock);
+    vector<shared_ptr<ThreadBuffer>> snapshot = buffers;
+    pthread_mutex_unlock(&buffersLock);
+
+    size_t consumed = 0;
+    for (shared_ptr<ThreadBuffer>& b : snapshot) {
+      uint64_t tail = b->tail.load(memory_order_relaxed);
+      uint64_t head = b->head.load(memory_order_acquire);
+      for (; tail < head; tail++) {
+        consume(b->records[tail % ThreadBuffer::kCapacity]);
+        consumed++;
+      }
+      b->tail.store(tail, memory_order_release);
+    }
+    if (consumed > 0) {
+      endPass();
+    }
+
+    // Forget buffers of exited threads once they are empty
+    pthread_mutex_lock(&buffersLock);
+    for (size_t i = 0; i < buffers.size();) {
+      ThreadBuffer& b = *buffers[i];
+      if (b.orphaned.load(memory_order_acquire) && b.tail.load(memory_order_relaxed) == b.head.load(memory_order_acquire)) {
+        buffers[i] = buffers.back();
+        buffers.pop_back();
+      }
+      else {
+        i++;
+      }
+    }
+    pthread_mutex_unlock(&buffersLock);
+    return consumed;
+  }
+
+  void run() {
+    while (true) {
+      size_t consumed = drain();
+      passes.fetch_add(1, memory_order_seq_cst);
+      if (passWaiters.load(memory_order_seq_cst) > 0) {
+        futex(&passes, FUTEX_WAKE_PRIVATE, INT_MAX);
+      }
+      if (consumed > 0) {
+        continue;
+      }
+      if (stopping.load(memory_order_acquire)) {
+        if (!anyPending()) {
+          return;
+        }
+        continue;
+      }
+      // Announce the nap before the last look at the rings, a producer storing after it sees sleeping == 1
+      sleeping.store(1, memory_order_seq_cst);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (anyPending() || stopping.load(memory_order_acquire)) {
+        sleeping.store(0, memory_order_relaxed);
+        continue;
+      }
+      while (sleeping.load(memory_order_acquire) == 1) {
+        futex(&sleeping, FUTEX_WAIT_PRIVATE, 1);
+      }
+    }
+  }
+
+public:
+  AsyncRecorder(function<void(const Record&)> consume, function<void()> endPass) : consume(consume), endPass(endPass) {}
+
+  ~AsyncRecorder() {
+    stop();
+  }
+
+  /*
+    Consumes what is left and joins the drainer, owners call it before tearing down what consume uses
+  */
+  void stop() {
+    pthread_mutex_lock(&buffersLock);
+    stopping.store(true, memory_order_seq_cst);
+    bool joinable = started && drainer.joinable();
+    pthread_mutex_unlock(&buffersLock);
+    if (joinable) {
+      wakeDrainer();
+      drainer.join();
+    }
+  }
+
+  void push(const Record& r) {
+    ThreadBuffer& b = threadBuffer();
+    uint64_t head = b.head.load(memory_order_relaxed);
+    // Only waits if the drainer is a full ring behind
+    while (head - b.tail.load(memory_order_acquire) >= ThreadBuffer::kCapacity) {
+      sched_yield();
+    }
+    b.records[head % ThreadBuffer::kCapacity] = r;
+    b.head.store(head + 1, memory_order_release);
+    // Pairs with the drainer's fence, either it sees this record or this thread sees it asleep
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sleeping.load(memory_order_relaxed) == 1) {
+      wakeDrainer();
+    }
+  }
+
+  /*
+    Sleeps until done() holds, rechecking after every drain pass
+    done() must become true through records that were pushed, or it may never return
+  */
+  void waitUntil(function<bool()> done) {
+    passWaiters.fetch_add(1, memory_order_seq_cst);
+    while (true) {
+      uint32_t seen = passes.load(memory_order_seq_cst);
+      if (done()) {
+        break;
+      }
+      futex(&passes, FUTEX_WAIT_PRIVATE, seen);
+    }
+    passWaiters.fetch_sub(1, memory_order_relaxed);
+  }
+};
+
+/*
+  "Adding thread with ID: <tid> to level <level>" message of MLFQMutex::lock()
+*/
+struct LogRecord {
+  unsigned long tid;
+  int level;
+};
+
+/*
+  Asynchronous logger, threads append fixed-size records and a background thread formats and
+  writes them, so no stdout I/O happens on the caller's path
+*/
+class AsyncLog {
+private:
+  AsyncRecorder<LogRecord> recorder;
+
+  AsyncLog() : recorder([](const LogRecord& r) { cout << "Adding thread with ID: " << r.tid << " to level " << r.level << "\n"; },
+                        []() { cout.flush(); }) {}
+
+public:
+  static AsyncLog& instance() {
+    static AsyncLog log;
+    return log;
+  }
+
+  void log(unsigned long tid, int level) {
+    recorder.push({tid, level});
+  }
+};
+
+#endif
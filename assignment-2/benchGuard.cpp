@@ -0,0 +1,73 @@
+#include <iostream>
+#include <pthread.h>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "spinlock.h"
+using namespace std;
+
+/*
+  Compares the old test-and-set guard against the MCS guard used by MLFQMutex
+  Usage: ./benchGuard [iterations per thread]
+  Prints one CSV line per lock and thread count
+*/
+
+TASLock tasLock;
+MCSLock mcsLock;
+long counter = 0; // Protected by the lock under test
+long iterations = 20000;
+
+void* tasWorker(void* args) {
+    for (long i = 0; i < iterations; i++) {
+        tasLock.lock();
+        counter++;
+        tasLock.unlock();
+    }
+    return NULL;
+}
+
+void* mcsWorker(void* args) {
+    for (long i = 0; i < iterations; i++) {
+        MCSLock::Node node;
+        mcsLock.lock(node);
+        counter++;
+        mcsLock.unlock(node);
+    }
+    return NULL;
+}
+
+void run(const char* name, void* (*worker)(void*), int numThreads) {
+    vector<pthread_t> threads;
+    counter = 0;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, worker, NULL);
+        threads.push_back(thread);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+    if (counter != iterations * numThreads) {
+        printf("%s lost updates: %ld of %ld\n", name, counter, iterations * numThreads);
+        exit(1);
+    }
+    printf("%s,%d,%ld,%.6f,%.0f\n", name, numThreads, counter, duration, counter / duration);
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+    int threadCounts[] = {4, 16, 64};
+    printf("lock,threads,ops,seconds,ops_per_sec\n");
+    for (int n : threadCounts) {
+        run("tas", tasWorker, n);
+        run("mcs", mcsWorker, n);
+    }
+    return 0;
+}
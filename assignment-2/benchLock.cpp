@@ -0,0 +1,160 @@
+#include <iostream>
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "spinlock.h"
+#include "benchUtil.h"
+#include "MLFQmutex.h"
+using namespace std;
+
+/*
+  Compares MLFQMutex against std::mutex, pthread_mutex_t, a ticket lock and a TAS lock
+  Usage: ./benchLock [seconds per run] [max threads]
+  Every run sweeps one lock, thread count, critical section length, non-critical work and (for MLFQMutex)
+  level count, and prints one CSV line with throughput, Jain's fairness index over the per-thread
+  acquisition counts and the p50/p99/p99.9 time lock() took.
+*/
+
+double runSeconds = 0.1;
+int maxThreads = 16;
+
+/*
+  pthread_mutex_t with the lock()/unlock() interface of the other locks
+*/
+class PthreadLock {
+private:
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+public:
+  void lock() {
+    pthread_mutex_lock(&mutex);
+  }
+
+  void unlock() {
+    pthread_mutex_unlock(&mutex);
+  }
+};
+
+struct Config {
+  int threads;
+  int levels;       // MLFQMutex priority levels, 0 for the other locks
+  long long csNs;   // Work inside the critical section
+  long long nonCsNs; // Work between two acquisitions
+};
+
+template<class Lock>
+struct Shared {
+  Lock* lock;
+  Config config;
+  atomic<bool> go{false};
+  atomic<bool> stop{false};
+  long counter = 0; // Protected by the lock under test
+};
+
+template<class Lock>
+struct WorkerArgs {
+  Shared<Lock>* shared;
+  long ops = 0;
+  LatencyHist latency;
+};
+
+template<class Lock>
+void* worker(void* args) {
+  WorkerArgs<Lock>* w = (WorkerArgs<Lock>*)args;
+  Shared<Lock>* s = w->shared;
+  while (!s->go.load(memory_order_acquire)) {
+    sched_yield();
+  }
+  while (!s->stop.load(memory_order_relaxed)) {
+    long long begin = nowNs();
+    s->lock->lock();
+    w->latency.add(nowNs() - begin);
+    s->counter++;
+    work(s->config.csNs);
+    s->lock->unlock();
+    w->ops++;
+    work(s->config.nonCsNs);
+  }
+  return NULL;
+}
+
+template<class Lock>
+void run(const char* name, Lock& lock, const Config& config) {
+  Shared<Lock> shared;
+  shared.lock = &lock;
+  shared.config = config;
+  vector<WorkerArgs<Lock>> args(config.threads);
+  vector<pthread_t> threads(config.threads);
+  for (int i = 0; i < config.threads; i++) {
+    args[i].shared = &shared;
+    pthread_create(&threads[i], NULL, worker<Lock>, &args[i]);
+  }
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+  shared.go.store(true, memory_order_release);
+  usleep((useconds_t)(runSeconds * 1e6));
+  shared.stop.store(true, memory_order_relaxed);
+  for (int i = 0; i < config.threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+
+  long total = 0;
+  double sumSquares = 0;
+  LatencyHist latency;
+  for (WorkerArgs<Lock>& a : args) {
+    total += a.ops;
+    sumSquares += (double)a.ops * a.ops;
+    latency.merge(a.latency);
+  }
+  if (shared.counter != total) {
+    printf("%s lost updates: %ld of %ld\n", name, shared.counter, total);
+    exit(1);
+  }
+  double jain = sumSquares > 0 ? (double)total * total / (config.threads * sumSquares) : 0;
+  printf("%s,%d,%d,%lld,%lld,%ld,%.6f,%.0f,%.4f,%llu,%llu,%llu\n", name, config.threads, config.levels, config.csNs,
+    config.nonCsNs, total, duration, total / duration, jain, (unsigned long long)latency.percentile(0.5),
+    (unsigned long long)latency.percentile(0.99), (unsigned long long)latency.percentile(0.999));
+  fflush(stdout);
+}
+
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    runSeconds = atof(argv[1]);
+  }
+  if (argc > 2) {
+    maxThreads = atoi(argv[2]);
+  }
+  long long csLengths[] = {0, 200, 2000};
+  long long nonCsLengths[] = {0, 1000};
+  int levelCounts[] = {1, 4, 16};
+  printf("lock,threads,levels,cs_ns,noncs_ns,ops,seconds,ops_per_sec,jain,p50_ns,p99_ns,p999_ns\n");
+  for (int n = 1; n <= maxThreads; n *= 4) {
+    for (long long cs : csLengths) {
+      for (long long nonCs : nonCsLengths) {
+        Config config = {n, 0, cs, nonCs};
+        mutex stdMutex;
+        run("std::mutex", stdMutex, config);
+        PthreadLock pthreadLock;
+        run("pthread_mutex", pthreadLock, config);
+        TicketLock ticketLock;
+        run("ticket", ticketLock, config);
+        TASLock tasLock;
+        run("tas", tasLock, config);
+        for (int levels : levelCounts) {
+          config.levels = levels;
+          // 1 us quantum, so the longer critical sections demote threads and the levels come into play
+          MLFQMutex mlfq(levels, 1e-6);
+          mlfq.setVerbose(false);
+          run("mlfq", mlfq, config);
+        }
+      }
+    }
+  }
+  return 0;
+}
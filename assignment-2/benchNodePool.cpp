@@ -0,0 +1,77 @@
+#include <iostream>
+#include <pthread.h>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "queue.h"
+using namespace std;
+
+/*
+  Cost of one enqueue+dequeue pair when a thread works on many queues at once, as MLFQMutex does with
+  one queue per priority level
+  Usage: ./benchNodePool [pairs per thread]
+  Each thread cycles over every queue, so the node pool's thread cache has to hold one entry per queue.
+  Prints one CSV line per allocator, queue count and thread count
+*/
+
+long pairs = 2000000;
+
+template<class Q>
+struct Shared {
+  vector<Q*> queues;
+};
+
+template<class Q>
+void* worker(void* args) {
+  Shared<Q>* s = (Shared<Q>*)args;
+  size_t n = s->queues.size();
+  long item;
+  for (long i = 0; i < pairs; i++) {
+    Q* q = s->queues[i % n];
+    q->enqueue(i);
+    if (!q->tryDequeue(item)) {
+      printf("Queue unexpectedly empty\n");
+      exit(1);
+    }
+  }
+  return NULL;
+}
+
+template<class Q>
+void run(const char* name, int numQueues, int numThreads) {
+  Shared<Q> shared;
+  for (int i = 0; i < numQueues; i++) {
+    shared.queues.push_back(new Q());
+  }
+  vector<pthread_t> threads(numThreads);
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+  for (int i = 0; i < numThreads; i++) {
+    pthread_create(&threads[i], NULL, worker<Q>, &shared);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+  printf("%s,%d,%d,%ld,%.6f,%.1f\n", name, numQueues, numThreads, pairs * numThreads, duration,
+    duration * 1e9 / (pairs * numThreads));
+  for (Q* q : shared.queues) {
+    delete q;
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    pairs = atol(argv[1]);
+  }
+  printf("allocator,queues,threads,pairs,seconds,ns_per_pair\n");
+  for (int threads : {1, 4}) {
+    for (int queues : {1, 4, 5, 8, 16, 64}) {
+      run<Queue<long>>("pool", queues, threads);
+      run<Queue<long, HeapNodeAllocator<Node<long>>>>("heap", queues, threads);
+    }
+  }
+  return 0;
+}
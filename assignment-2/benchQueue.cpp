@@ -0,0 +1,322 @@
+#include <iostream>
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "benchUtil.h"
+#include "queue.h"
+#include "lfqueue.h"
+#include "ringQueue.h"
+using namespace std;
+
+/*
+  Multi-producer/multi-consumer benchmark and stress test for the queues
+  Usage: ./benchQueue [items per producer]
+  Every run pushes a fixed number of items per producer through one queue and prints one CSV line
+  with throughput and the p50/p99 latency of enqueue and of successful dequeues. Afterwards it checks
+  that every item came out exactly once and that each consumer saw the items of each producer in the
+  order they were produced, which any linearizable FIFO queue guarantees. A failed check exits with 1.
+  The ring-bulk runs move kBatch items per call, their latencies are per call. The -unpadded runs use the
+  same queue with its hot fields packed together instead of on separate cache lines.
+*/
+
+long itemsPerProducer = 100000;
+const size_t kBatch = 32;
+
+/*
+  Item of Size bytes, tagged with its producer and sequence number
+*/
+template<int Size>
+struct Payload {
+  uint32_t producer;
+  uint32_t seq;
+  char data[Size - 8];
+
+  Payload() : producer(0), seq(0) {}
+};
+
+/*
+  std::deque behind one pthread mutex, the baseline the two-lock queue has to beat
+*/
+template<typename T>
+class MutexQueue {
+private:
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  deque<T> items;
+
+public:
+  void enqueue(const T& item) {
+    pthread_mutex_lock(&lock);
+    items.push_back(item);
+    pthread_mutex_unlock(&lock);
+  }
+
+  bool tryDequeue(T& item) {
+    pthread_mutex_lock(&lock);
+    bool found = !items.empty();
+    if (found) {
+      item = items.front();
+      items.pop_front();
+    }
+    pthread_mutex_unlock(&lock);
+    return found;
+  }
+};
+
+struct Config {
+  int producers;
+  int consumers;
+  bool pinned; // Threads pinned round-robin to the online CPUs
+};
+
+template<class Q>
+struct Shared {
+  Q* queue;
+  Config config;
+  atomic<bool> go{false};
+  atomic<bool> producersDone{false};
+};
+
+struct ThreadArgs {
+  void* shared;
+  int index; // Producer id, or consumer number
+  int cpu;   // Pinning slot, producers and consumers get separate CPUs where possible
+  LatencyHist latency;
+  vector<uint64_t> received; // producer << 32 | seq of every dequeued item, in dequeue order
+};
+
+template<class Q, class T>
+void* producer(void* args) {
+  ThreadArgs* a = (ThreadArgs*)args;
+  Shared<Q>* s = (Shared<Q>*)a->shared;
+  if (s->config.pinned) {
+    pinThread(a->cpu);
+  }
+  while (!s->go.load(memory_order_acquire)) {
+    sched_yield();
+  }
+  T item;
+  item.producer = a->index;
+  for (long i = 0; i < itemsPerProducer; i++) {
+    item.seq = (uint32_t)i;
+    long long begin = nowNs();
+    s->queue->enqueue(item);
+    a->latency.add(nowNs() - begin);
+  }
+  return NULL;
+}
+
+template<class Q, class T>
+void* consumer(void* args) {
+  ThreadArgs* a = (ThreadArgs*)args;
+  Shared<Q>* s = (Shared<Q>*)a->shared;
+  if (s->config.pinned) {
+    pinThread(a->cpu);
+  }
+  while (!s->go.load(memory_order_acquire)) {
+    sched_yield();
+  }
+  T item;
+  while (true) {
+    // Read the flag first, an empty queue after all producers finished stays empty
+    bool done = s->producersDone.load(memory_order_acquire);
+    long long begin = nowNs();
+    if (s->queue->tryDequeue(item)) {
+      a->latency.add(nowNs() - begin);
+      a->received.push_back((uint64_t)item.producer << 32 | item.seq);
+    }
+    else if (done) {
+      break;
+    }
+    else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+template<class Q, class T>
+void* bulkProducer(void* args) {
+  ThreadArgs* a = (ThreadArgs*)args;
+  Shared<Q>* s = (Shared<Q>*)a->shared;
+  if (s->config.pinned) {
+    pinThread(a->cpu);
+  }
+  while (!s->go.load(memory_order_acquire)) {
+    sched_yield();
+  }
+  T batch[kBatch];
+  for (long i = 0; i < itemsPerProducer;) {
+    size_t n = 0;
+    for (; n < kBatch && i + (long)n < itemsPerProducer; n++) {
+      batch[n].producer = a->index;
+      batch[n].seq = (uint32_t)(i + n);
+    }
+    size_t sent = 0;
+    while (sent < n) {
+      long long begin = nowNs();
+      size_t count = s->queue->enqueueBulk(batch + sent, n - sent);
+      if (count == 0) {
+        sched_yield(); // Full
+        continue;
+      }
+      a->latency.add(nowNs() - begin);
+      sent += count;
+    }
+    i += n;
+  }
+  return NULL;
+}
+
+template<class Q, class T>
+void* bulkConsumer(void* args) {
+  ThreadArgs* a = (ThreadArgs*)args;
+  Shared<Q>* s = (Shared<Q>*)a->shared;
+  if (s->config.pinned) {
+    pinThread(a->cpu);
+  }
+  while (!s->go.load(memory_order_acquire)) {
+    sched_yield();
+  }
+  T batch[kBatch];
+  while (true) {
+    bool done = s->producersDone.load(memory_order_acquire);
+    long long begin = nowNs();
+    size_t count = s->queue->dequeueBulk(batch, kBatch);
+    if (count > 0) {
+      a->latency.add(nowNs() - begin);
+      for (size_t i = 0; i < count; i++) {
+        a->received.push_back((uint64_t)batch[i].producer << 32 | batch[i].seq);
+      }
+    }
+    else if (done) {
+      break;
+    }
+    else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+/*
+  Returns an empty string if every item was dequeued once and in per-producer order, otherwise what went wrong
+*/
+string check(const Config& config, const vector<ThreadArgs>& args) {
+  vector<vector<uint8_t>> seen(config.producers, vector<uint8_t>(itemsPerProducer, 0));
+  for (int c = config.producers; c < (int)args.size(); c++) {
+    vector<long> last(config.producers, -1);
+    for (uint64_t id : args[c].received) {
+      uint32_t p = id >> 32;
+      uint32_t seq = (uint32_t)id;
+      if (p >= (uint32_t)config.producers || seq >= (uint64_t)itemsPerProducer) {
+        return "corrupt item";
+      }
+      if ((long)seq <= last[p]) {
+        return "producer " + to_string(p) + " out of order";
+      }
+      last[p] = seq;
+      if (seen[p][seq]++ != 0) {
+        return "duplicate item";
+      }
+    }
+  }
+  for (int p = 0; p < config.producers; p++) {
+    for (long i = 0; i < itemsPerProducer; i++) {
+      if (seen[p][i] == 0) {
+        return "lost item";
+      }
+    }
+  }
+  return "";
+}
+
+template<class Q, class T, bool Bulk = false>
+void run(const char* name, const Config& config) {
+  Q queue;
+  Shared<Q> shared;
+  shared.queue = &queue;
+  shared.config = config;
+  int numThreads = config.producers + config.consumers;
+  vector<ThreadArgs> args(numThreads);
+  vector<pthread_t> threads(numThreads);
+  for (int i = 0; i < numThreads; i++) {
+    args[i].shared = &shared;
+    args[i].index = i < config.producers ? i : i - config.producers;
+    args[i].cpu = i;
+    if (i >= config.producers) {
+      args[i].received.reserve(itemsPerProducer * config.producers);
+    }
+  }
+  for (int i = 0; i < numThreads; i++) {
+    void* (*fn)(void*);
+    if constexpr (Bulk) {
+      fn = i < config.producers ? bulkProducer<Q, T> : bulkConsumer<Q, T>;
+    }
+    else {
+      fn = i < config.producers ? producer<Q, T> : consumer<Q, T>;
+    }
+    pthread_create(&threads[i], NULL, fn, &args[i]);
+  }
+
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+  shared.go.store(true, memory_order_release);
+  for (int i = 0; i < config.producers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  shared.producersDone.store(true, memory_order_release);
+  for (int i = config.producers; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+
+  LatencyHist enqLatency, deqLatency;
+  for (int i = 0; i < numThreads; i++) {
+    (i < config.producers ? enqLatency : deqLatency).merge(args[i].latency);
+  }
+  string error = check(config, args);
+  long items = itemsPerProducer * config.producers;
+  printf("%s,%d,%d,%d,%d,%ld,%.6f,%.0f,%llu,%llu,%llu,%llu,%s\n", name, config.producers, config.consumers, (int)sizeof(T),
+    config.pinned, items, duration, items / duration, (unsigned long long)enqLatency.percentile(0.5),
+    (unsigned long long)enqLatency.percentile(0.99), (unsigned long long)deqLatency.percentile(0.5),
+    (unsigned long long)deqLatency.percentile(0.99), error.empty() ? "ok" : error.c_str());
+  fflush(stdout);
+  if (!error.empty()) {
+    exit(1);
+  }
+}
+
+template<class T>
+void runQueues(const Config& config) {
+  run<MutexQueue<T>, T>("mutex", config);
+  run<Queue<T>, T>("two-lock", config);
+  run<Queue<T, NodePool<Node<T>>, false>, T>("two-lock-unpadded", config);
+  run<LockFreeQueue<T>, T>("lock-free", config);
+  run<LockFreeQueue<T, false>, T>("lock-free-unpadded", config);
+  run<RingQueue<T>, T>("ring", config);
+  run<RingQueue<T>, T, true>("ring-bulk", config);
+}
+
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    itemsPerProducer = atol(argv[1]);
+  }
+  // producers:consumers
+  int ratios[][2] = {{1, 1}, {1, 3}, {3, 1}, {2, 2}, {4, 4}};
+  printf("queue,producers,consumers,payload_bytes,pinned,items,seconds,ops_per_sec,enq_p50_ns,enq_p99_ns,deq_p50_ns,deq_p99_ns,check\n");
+  for (bool pinned : {false, true}) {
+    for (auto& ratio : ratios) {
+      Config config = {ratio[0], ratio[1], pinned};
+      runQueues<Payload<8>>(config);
+      runQueues<Payload<64>>(config);
+      runQueues<Payload<256>>(config);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include "pthread.h"
+#include "spinlock.h"
+#include <bit>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sched.h>
+#include <vector>
+
+using namespace std;
+
+/*
+  Log-linear latency histogram, 16 sub-buckets per power of two so percentiles are within about 6%
+*/
+struct LatencyHist {
+  static const int kSubBits = 4;
+  static const int kBuckets = 64 << kSubBits;
+  vector<uint64_t> counts = vector<uint64_t>(kBuckets, 0);
+
+  static int bucket(uint64_t ns) {
+    if (ns < (1u << kSubBits)) {
+      return (int)ns;
+    }
+    int msb = 63 - countl_zero(ns);
+    int sub = (int)((ns >> (msb - kSubBits)) & ((1 << kSubBits) - 1));
+    return ((msb - kSubBits + 1) << kSubBits) + sub;
+  }
+
+  // Smallest value that falls in bucket b
+  static uint64_t lowerBound(int b) {
+    if (b < (1 << kSubBits)) {
+      return b;
+    }
+    int msb = (b >> kSubBits) + kSubBits - 1;
+    uint64_t sub = b & ((1 << kSubBits) - 1);
+    return (1ULL << msb) | (sub << (msb - kSubBits));
+  }
+
+  void add(uint64_t ns) {
+    counts[bucket(ns)]++;
+  }
+
+  void merge(const LatencyHist& other) {
+    for (int b = 0; b < kBuckets; b++) {
+      counts[b] += other.counts[b];
+    }
+  }
+
+  /*
+    Lower bound of the bucket holding the p-th quantile (0 <= p <= 1), by nearest rank ceil(p * total)
+  */
+  uint64_t percentile(double p) const {
+    uint64_t total = 0;
+    for (uint64_t c : counts) {
+      total += c;
+    }
+    if (total == 0) {
+      return 0;
+    }
+    uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(p * total));
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; b++) {
+      seen += counts[b];
+      if (seen >= rank) {
+        return lowerBound(b);
+      }
+    }
+    return lowerBound(kBuckets - 1);
+  }
+};
+
+inline long long nowNs() {
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Busy work for about ns nanoseconds, without touching shared memory
+inline void work(long long ns) {
+  if (ns <= 0) {
+    return;
+  }
+  long long end = nowNs() + ns;
+  while (nowNs() < end) {
+    cpuRelax();
+  }
+}
+
+/*
+  Pins the calling thread to one of the online CPUs, index wraps around, returns false if the kernel refused
+*/
+inline bool pinThread(int index) {
+  int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(index % (cpus > 0 ? cpus : 1), &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef CACHELINE_H
+#define CACHELINE_H
+
+#include <cstddef>
+#include <new>
+
+using namespace std;
+
+/*
+  Distance that keeps two fields from sharing a cache line
+  Everything here is header-only and compiled together, so the value GCC picks for the target CPU
+  cannot differ between translation units and its -Winterference-size warning does not apply.
+*/
+#ifdef __cpp_lib_hardware_interference_size
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+inline constexpr size_t kCacheLineSize = hardware_destructive_interference_size;
+#pragma GCC diagnostic pop
+#else
+inline constexpr size_t kCacheLineSize = 64;
+#endif
+
+/*
+  Alignment of the first field of a group that gets its own cache line
+  With Padded = false the field keeps the natural alignment of T, so a benchmark can compare the padded
+  layout of a class with the same fields packed together.
+*/
+template<typename T, bool Padded = true>
+inline constexpr size_t kLineAlign = Padded ? kCacheLineSize : alignof(T);
+
+#endif
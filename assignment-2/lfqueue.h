@@ -0,0 +1,329 @@
+#ifndef LFQUEUE_H
+#define LFQUEUE_H
+
+#include "cacheLine.h"
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+/*
+  Per-thread hazard pointer record, records are never freed, only reused by later threads
+*/
+struct alignas(kCacheLineSize) HazardRecord {
+  atomic<void*> hp[2];        // Nodes this thread is currently reading
+  atomic<bool> active;        // Whether a live thread owns this record
+  HazardRecord* next;         // Next record in the domain list
+
+  HazardRecord() : next(nullptr) {
+    hp[0].store(nullptr);
+    hp[1].store(nullptr);
+    active.store(true);
+  }
+};
+
+/*
+  A node that was unlinked but may still be read by another thread
+*/
+struct RetiredNode {
+  void* ptr;
+  void (*deleter)(void*);
+};
+
+/*
+  Hazard pointer domain shared by every LockFreeQueue (Michael, 2004)
+*/
+class HazardDomain {
+private:
+  atomic<HazardRecord*> head{nullptr}; // Lock-free list of all records
+  atomic<int> numRecords{0};           // Number of records in the list
+  mutex orphanLock;                    // Protects orphans
+  vector<RetiredNode> orphans;         // Retired nodes left behind by exited threads
+
+public:
+  static HazardDomain& instance() {
+    static HazardDomain domain;
+    return domain;
+  }
+
+  ~HazardDomain() {
+    for (RetiredNode& r : orphans) {
+      r.deleter(r.ptr);
+    }
+  }
+
+  /*
+    Reuses an inactive record or pushes a new one to the list
+  */
+  HazardRecord* acquire() {
+    for (HazardRecord* r = head.load(memory_order_acquire); r != nullptr; r = r->next) {
+      bool expected = false;
+      if (!r->active.load(memory_order_relaxed) && r->active.compare_exchange_strong(expected, true)) {
+        return r;
+      }
+    }
+    HazardRecord* r = new HazardRecord();
+    HazardRecord* old = head.load(memory_order_relaxed);
+    do {
+      r->next = old;
+    } while (!head.compare_exchange_weak(old, r, memory_order_release, memory_order_relaxed));
+    numRecords.fetch_add(1, memory_order_relaxed);
+    return r;
+  }
+
+  void release(HazardRecord* r) {
+    r->hp[0].store(nullptr, memory_order_release);
+    r->hp[1].store(nullptr, memory_order_release);
+    r->active.store(false, memory_order_release);
+  }
+
+  int recordCount() {
+    return numRecords.load(memory_order_relaxed);
+  }
+
+  /*
+    Frees every node in list that no hazard pointer refers to, keeps the rest in list
+  */
+  void scan(vector<RetiredNode>& list) {
+    vector<void*> hazards;
+    for (HazardRecord* r = head.load(memory_order_acquire); r != nullptr; r = r->next) {
+      for (int i = 0; i < 2; i++) {
+        void* p = r->hp[i].load(memory_order_seq_cst);
+        if (p != nullptr) {
+          hazards.push_back(p);
+        }
+      }
+    }
+    sort(hazards.begin(), hazards.end());
+
+    // Adopt orphans opportunistically so they are not kept forever
+    {
+      unique_lock<mutex> guard(orphanLock, try_to_lock);
+      if (guard.owns_lock() && !orphans.empty()) {
+        list.insert(list.end(), orphans.begin(), orphans.end());
+        orphans.clear();
+      }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < list.size(); i++) {
+      if (binary_search(hazards.begin(), hazards.end(), list[i].ptr)) {
+        list[kept++] = list[i];
+      }
+      else {
+        list[i].deleter(list[i].ptr);
+      }
+    }
+    list.resize(kept);
+  }
+
+  void adopt(vector<RetiredNode>& list) {
+    lock_guard<mutex> guard(orphanLock);
+    orphans.insert(orphans.end(), list.begin(), list.end());
+    list.clear();
+  }
+};
+
+/*
+  Thread-local handle to a hazard record and the list of nodes this thread retired
+*/
+class HazardThread {
+private:
+  HazardRecord* record;
+  vector<RetiredNode> retired;
+
+public:
+  HazardThread() : record(HazardDomain::instance().acquire()) {}
+
+  ~HazardThread() {
+    HazardDomain& domain = HazardDomain::instance();
+    record->hp[0].store(nullptr);
+    record->hp[1].store(nullptr);
+    domain.scan(retired);
+    if (!retired.empty()) {
+      domain.adopt(retired); // Still protected by someone else, hand over to the domain
+    }
+    domain.release(record);
+  }
+
+  /*
+    Publishes the value of src in slot i and returns it once it is stable
+  */
+  template<typename N>
+  N* protect(int i, atomic<N*>& src) {
+    N* p = src.load(memory_order_relaxed);
+    while (true) {
+      record->hp[i].store(p, memory_order_seq_cst);
+      N* q = src.load(memory_order_seq_cst);
+      if (q == p) {
+        return p;
+      }
+      p = q;
+    }
+  }
+
+  void set(int i, void* p) {
+    record->hp[i].store(p, memory_order_seq_cst);
+  }
+
+  void clear() {
+    record->hp[0].store(nullptr, memory_order_release);
+    record->hp[1].store(nullptr, memory_order_release);
+  }
+
+  void retire(void* p, void (*deleter)(void*)) {
+    retired.push_back({p, deleter});
+    if ((int)retired.size() >= 2 * HazardDomain::instance().recordCount() + 64) {
+      HazardDomain::instance().scan(retired);
+    }
+  }
+};
+
+inline HazardThread& hazardThread() {
+  thread_local HazardThread t;
+  return t;
+}
+
+template<typename T>
+class LFNode {
+public:
+  T value;
+  atomic<LFNode*> next;
+
+  LFNode() : value(T()), next(nullptr) {}
+  LFNode(T val) : value(val), next(nullptr) {}
+};
+
+/*
+  Lock-free Michael and Scott Queue, dequeued nodes are reclaimed with hazard pointers
+  Padded = false lets head and tail share a cache line, for benchmarks
+*/
+template<typename T, bool Padded = true>
+class LockFreeQueue {
+
+private:
+  // Dequeuers CAS head and enqueuers CAS tail, separate lines keep each side's CAS from invalidating the other's
+  alignas(kLineAlign<atomic<LFNode<T>*>, Padded>) atomic<LFNode<T>*> head;
+  alignas(kLineAlign<atomic<LFNode<T>*>, Padded>) atomic<LFNode<T>*> tail;
+
+  static void deleteNode(void* p) {
+    delete static_cast<LFNode<T>*>(p);
+  }
+
+public:
+  LockFreeQueue() {
+    LFNode<T>* tmp = new LFNode<T>();
+    head.store(tmp);
+    tail.store(tmp);
+  }
+
+  // Assumes no other thread is still using the queue
+  ~LockFreeQueue() {
+    LFNode<T>* iter = head.load();
+    while (iter != nullptr) {
+      LFNode<T>* next = iter->next.load();
+      delete iter;
+      iter = next;
+    }
+  }
+
+  LockFreeQueue(const LockFreeQueue&) = delete;
+  LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+  void enqueue(T item) {
+    LFNode<T>* tmp = new LFNode<T>(item);
+    HazardThread& ht = hazardThread();
+    while (true) {
+      LFNode<T>* last = ht.protect(0, tail);
+      LFNode<T>* next = last->next.load(memory_order_acquire);
+      if (last != tail.load(memory_order_acquire)) {
+        continue;
+      }
+      if (next == nullptr) {
+        // Link the new node after the last node, then try to swing tail to it
+        if (last->next.compare_exchange_weak(next, tmp, memory_order_release, memory_order_relaxed)) {
+          tail.compare_exchange_strong(last, tmp, memory_order_release, memory_order_relaxed);
+          break;
+        }
+      }
+      else {
+        // Tail is lagging behind, help the other enqueuer
+        tail.compare_exchange_strong(last, next, memory_order_release, memory_order_relaxed);
+      }
+    }
+    ht.clear();
+  };
+
+  T dequeue() {
+    T value;
+    if (!tryDequeue(value)) {
+      throw out_of_range("Attempt to dequeue from an empty queue");
+    }
+    return value;
+  };
+
+  /*
+    Copies the oldest item into item and removes it, returns false instead of throwing if the queue is empty
+  */
+  bool tryDequeue(T& item) {
+    HazardThread& ht = hazardThread();
+    while (true) {
+      LFNode<T>* first = ht.protect(0, head);
+      LFNode<T>* last = tail.load(memory_order_acquire);
+      LFNode<T>* next = first->next.load(memory_order_acquire);
+      ht.set(1, next);
+      // Head did not move, so next is still reachable and protected
+      if (first != head.load(memory_order_seq_cst)) {
+        continue;
+      }
+      if (next == nullptr) {
+        ht.clear();
+        return false;
+      }
+      if (first == last) {
+        tail.compare_exchange_strong(last, next, memory_order_release, memory_order_relaxed);
+        continue;
+      }
+      item = next->value;
+      if (head.compare_exchange_strong(first, next, memory_order_acq_rel, memory_order_relaxed)) {
+        ht.clear();
+        ht.retire(first, deleteNode);
+        return true;
+      }
+    }
+  }
+
+  bool isEmpty() {
+    HazardThread& ht = hazardThread();
+    LFNode<T>* first = ht.protect(0, head);
+    bool empty = first->next.load(memory_order_acquire) == nullptr;
+    ht.clear();
+    return empty;
+  }
+
+  // Not safe to call concurrently with dequeue
+  void print() {
+    LFNode<T>* iter = head.load()->next.load();
+    if (iter == nullptr) {
+      cout << "Empty\n";
+      return;
+    }
+    while (iter != nullptr) {
+      if (iter->next.load() != nullptr) {
+        cout << iter->value << " ";
+      }
+      else {
+        cout << iter->value << "\n";
+      }
+      iter = iter->next.load();
+    }
+  }
+
+
+};
+
+#endif
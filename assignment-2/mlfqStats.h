@@ -0,0 +1,234 @@
+#ifndef MLFQSTATS_H
+#define MLFQSTATS_H
+
+#include "pthread.h"
+#include <atomic>
+#include <bit>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/*
+  Counters one thread collects on one MLFQMutex
+  Only the owning thread writes them, readers may sum them at any time
+*/
+struct LockStats {
+  static const int kBuckets = 32;     // Bucket b counts times in [2^(b-1), 2^b) ns, the last one everything longer
+  static const int kMaxLevels = 64;   // Histogram rows, deeper levels share the last row
+
+  atomic<bool> inUse;                 // Owned by a live thread, free blocks are handed to new threads
+  int numLevels;                      // Histogram rows
+  atomic<uint64_t> acquisitions;      // Every successful lock()
+  atomic<uint64_t> contended;         // Acquisitions that found the lock held
+  atomic<uint64_t> demotions;         // unlock() calls that lowered the thread's priority
+  atomic<uint64_t> handoffs;          // Acquisitions handed over by unlock() while parked
+  atomic<uint64_t> timeouts;          // try_lock_for/try_lock_until calls that gave up
+  unique_ptr<atomic<uint64_t>[]> waitHist;    // numLevels x kBuckets wait times in lock()
+  unique_ptr<atomic<uint64_t>[]> holdHist;    // numLevels x kBuckets critical section times
+  atomic<uint64_t> handoffHist[kBuckets];     // Time from unpark() to the woken thread running
+
+  LockStats(int levels) : inUse(true), numLevels(levels < kMaxLevels ? levels : kMaxLevels),
+    acquisitions(0), contended(0), demotions(0), handoffs(0), timeouts(0),
+    waitHist(new atomic<uint64_t>[numLevels * kBuckets]), holdHist(new atomic<uint64_t>[numLevels * kBuckets]) {
+    for (int i = 0; i < numLevels * kBuckets; i++) {
+      waitHist[i].store(0, memory_order_relaxed);
+      holdHist[i].store(0, memory_order_relaxed);
+    }
+    for (int i = 0; i < kBuckets; i++) {
+      handoffHist[i].store(0, memory_order_relaxed);
+    }
+  }
+
+  static int bucket(long long ns) {
+    int b = ns <= 0 ? 0 : 64 - countl_zero((uint64_t)ns);
+    return b < kBuckets ? b : kBuckets - 1;
+  }
+
+  // Single writer, so a plain load and store is enough and avoids a locked instruction
+  static void bump(atomic<uint64_t>& counter) {
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+  }
+
+  int row(int level) const {
+    return level < numLevels ? level : numLevels - 1;
+  }
+
+  void recordAcquire(int level, long long waitNs, bool wasContended) {
+    bump(acquisitions);
+    if (wasContended) {
+      bump(contended);
+    }
+    bump(waitHist[row(level) * kBuckets + bucket(waitNs)]);
+  }
+
+  void recordHandoff(long long latencyNs) {
+    bump(handoffs);
+    bump(handoffHist[bucket(latencyNs)]);
+  }
+
+  void recordTimeout() {
+    bump(timeouts);
+  }
+
+  void recordHold(int level, long long holdNs, bool demoted) {
+    bump(holdHist[row(level) * kBuckets + bucket(holdNs)]);
+    if (demoted) {
+      bump(demotions);
+    }
+  }
+};
+
+/*
+  Snapshot of the counters of all threads on one MLFQMutex
+*/
+struct MLFQStats {
+  uint64_t acquisitions = 0;
+  uint64_t contended = 0;
+  uint64_t demotions = 0;
+  uint64_t handoffs = 0;
+  uint64_t timeouts = 0;
+  uint64_t boosts = 0;
+  vector<vector<uint64_t>> waitHist;  // Per level, LockStats::kBuckets each
+  vector<vector<uint64_t>> holdHist;
+  vector<uint64_t> handoffHist;
+
+  MLFQStats(int numLevels = 0) : waitHist(numLevels < LockStats::kMaxLevels ? numLevels : LockStats::kMaxLevels, vector<uint64_t>(LockStats::kBuckets, 0)),
+    holdHist(waitHist), handoffHist(LockStats::kBuckets, 0) {}
+
+  void add(const LockStats& s) {
+    acquisitions += s.acquisitions.load(memory_order_relaxed);
+    contended += s.contended.load(memory_order_relaxed);
+    demotions += s.demotions.load(memory_order_relaxed);
+    handoffs += s.handoffs.load(memory_order_relaxed);
+    timeouts += s.timeouts.load(memory_order_relaxed);
+    for (int level = 0; level < s.numLevels && level < (int)waitHist.size(); level++) {
+      for (int b = 0; b < LockStats::kBuckets; b++) {
+        waitHist[level][b] += s.waitHist[level * LockStats::kBuckets + b].load(memory_order_relaxed);
+        holdHist[level][b] += s.holdHist[level * LockStats::kBuckets + b].load(memory_order_relaxed);
+      }
+    }
+    for (int b = 0; b < LockStats::kBuckets; b++) {
+      handoffHist[b] += s.handoffHist[b].load(memory_order_relaxed);
+    }
+  }
+
+  /*
+    Upper bound in ns of the bucket holding the p-th quantile (0 <= p <= 1), 0 if the histogram is empty
+    Uses the nearest rank, ceil(p * total), so p99 of 100 samples is the 99th value and p99.9 the largest
+  */
+  static long long percentileNs(const vector<uint64_t>& hist, double p) {
+    uint64_t total = 0;
+    for (uint64_t c : hist) {
+      total += c;
+    }
+    if (total == 0) {
+      return 0;
+    }
+    uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(p * total));
+    uint64_t seen = 0;
+    for (int b = 0; b < (int)hist.size(); b++) {
+      seen += hist[b];
+      if (seen >= rank) {
+        return b == 0 ? 0 : 1LL << b;
+      }
+    }
+    return 1LL << (hist.size() - 1);
+  }
+
+  void print(ostream& os) const {
+    os << "Acquisitions: " << acquisitions << ", contended: " << contended << ", demotions: " << demotions
+       << ", handoffs: " << handoffs << ", timeouts: " << timeouts << ", boosts: " << boosts << "\n";
+    os << "Handoff latency p50/p99: " << percentileNs(handoffHist, 0.5) << "/" << percentileNs(handoffHist, 0.99) << " ns\n";
+    for (int level = 0; level < (int)waitHist.size(); level++) {
+      uint64_t count = 0;
+      for (uint64_t c : holdHist[level]) {
+        count += c;
+      }
+      if (count == 0) {
+        continue;
+      }
+      os << "Level " << level << ": " << count << " holds, wait p50/p99 " << percentileNs(waitHist[level], 0.5) << "/"
+         << percentileNs(waitHist[level], 0.99) << " ns, hold p50/p99 " << percentileNs(holdHist[level], 0.5) << "/"
+         << percentileNs(holdHist[level], 0.99) << " ns\n";
+    }
+  }
+};
+
+enum TraceEventType : uint8_t {
+  kTraceWait,     // Time from lock() to acquisition
+  kTraceHold,     // Critical section
+  kTraceEnqueue,  // Thread queued at a level
+  kTraceHandoff,  // unlock() passed the lock to a parked thread
+  kTraceDemote,   // Thread moved to a lower priority level
+  kTraceBoost     // Every thread moved back to level 0
+};
+
+struct TraceEvent {
+  long long ns;         // Start time
+  long long durNs;      // Duration for wait and hold events
+  unsigned long tid;    // Thread that recorded the event
+  int level;            // Priority level involved
+  TraceEventType type;
+};
+
+/*
+  Fixed-size ring of lock events, the oldest are overwritten once it is full
+*/
+class LockTrace {
+private:
+  vector<TraceEvent> events;
+  uint64_t mask;
+  atomic<uint64_t> next{0};
+
+public:
+  LockTrace(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    events.resize(size);
+    mask = size - 1;
+  }
+
+  void record(TraceEventType type, int level, long long ns, long long durNs = 0) {
+    uint64_t i = next.fetch_add(1, memory_order_relaxed);
+    events[i & mask] = {ns, durNs, (unsigned long)pthread_self(), level, type};
+  }
+
+  /*
+    Writes the events as Chrome trace JSON (chrome://tracing, Perfetto), call while no thread uses the lock
+  */
+  void exportChromeTrace(ostream& os) const {
+    static const char* names[] = {"wait", "hold", "enqueue", "handoff", "demote", "boost"};
+    uint64_t end = next.load(memory_order_acquire);
+    uint64_t begin = end > events.size() ? end - events.size() : 0;
+    ios::fmtflags flags = os.flags();
+    streamsize precision = os.precision();
+    os << fixed << setprecision(3); // Chrome trace times are in microseconds
+    os << "{\"traceEvents\":[";
+    for (uint64_t i = begin; i < end; i++) {
+      const TraceEvent& e = events[i & mask];
+      bool span = e.type == kTraceWait || e.type == kTraceHold;
+      os << (i == begin ? "" : ",") << "\n{\"name\":\"" << names[e.type] << "\",\"ph\":\"" << (span ? "X" : "i")
+         << "\",\"ts\":" << e.ns / 1000.0 << ",\"pid\":0,\"tid\":" << e.tid;
+      if (span) {
+        os << ",\"dur\":" << e.durNs / 1000.0;
+      }
+      else {
+        os << ",\"s\":\"t\"";
+      }
+      os << ",\"args\":{\"level\":" << e.level << "}}";
+    }
+    os << "\n]}\n";
+    os.flags(flags);
+    os.precision(precision);
+  }
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include "pthread.h"
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+/*
+  Plain heap allocator, one global new/delete per node
+*/
+template<typename N>
+class HeapNodeAllocator {
+public:
+  void* allocate() {
+    return ::operator new(sizeof(N));
+  }
+
+  void deallocate(void* p) {
+    ::operator delete(p);
+  }
+};
+
+/*
+  Ids of live pools, consulted only when a thread cache hands nodes back outside the owning pool's calls
+*/
+struct PoolRegistry {
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  unordered_set<uint64_t> live;
+  atomic<uint64_t> nextId{1};
+};
+
+inline PoolRegistry& poolRegistry() {
+  static PoolRegistry registry;
+  return registry;
+}
+
+/*
+  Per-queue node arena, nodes are recycled through a thread-local cache and a central list of batches.
+  Steady state allocate/deallocate only touches the calling thread's cache.
+*/
+template<typename N>
+class NodePool {
+
+private:
+  static const int kBatch = 64;     // Nodes moved between a thread cache and the central list at once
+  static const size_t kSweepSize = 64; // Cache entries a thread keeps before dropping those of destroyed pools
+
+  union FreeNode {
+    FreeNode* next;
+    alignas(N) unsigned char storage[sizeof(N)];
+  };
+
+  struct Batch {
+    FreeNode* head;
+    int count;
+  };
+
+  struct CacheEntry {
+    uint64_t id = 0;        // Id of the owning pool, 0 if unused
+    NodePool* pool = nullptr;
+    FreeNode* head = nullptr;
+    int count = 0;
+  };
+
+  /*
+    Free nodes cached by one thread for every pool of this node type it uses, there is no fixed number of
+    ways, so a thread working with many queues (one MLFQMutex level each) never evicts on the fast path
+  */
+  struct ThreadCache {
+    unordered_map<uint64_t, CacheEntry> entries; // By pool id, references stay valid across inserts
+    CacheEntry* last = nullptr;                  // Entry of the most recently used pool, checked first
+    size_t sweepAt = kSweepSize;                 // Size at which entries of destroyed pools are dropped
+
+    ~ThreadCache() {
+      for (auto& entry : entries) {
+        flush(entry.second);
+      }
+      cacheGone() = true;
+    }
+  };
+
+  uint64_t id;                  // Never reused, so stale cache entries cannot match a new pool
+  pthread_mutex_t centralLock;  // Protects batches and chunks
+  vector<Batch> batches;        // Free nodes shared by all threads
+  vector<FreeNode*> chunks;     // Arena chunks, released with the pool
+
+  static ThreadCache& threadCache() {
+    thread_local ThreadCache cache;
+    return cache;
+  }
+
+  // Set once this thread's cache is destroyed, e.g. while static queues are torn down at exit
+  static bool& cacheGone() {
+    thread_local bool gone = false;
+    return gone;
+  }
+
+  /*
+    Hands the entry's nodes back to its pool if the pool is still alive, otherwise its arena is already gone
+  */
+  static void flush(CacheEntry& e) {
+    if (e.id != 0 && e.head != nullptr) {
+      PoolRegistry& registry = poolRegistry();
+      pthread_mutex_lock(&registry.lock);
+      if (registry.live.count(e.id) != 0) {
+        e.pool->pushBatch(e.head, e.count);
+      }
+      pthread_mutex_unlock(&registry.lock);
+    }
+    e = CacheEntry();
+  }
+
+  /*
+    Drops the entries of pools destroyed since the last sweep, their nodes went away with the arena
+  */
+  static void sweep(ThreadCache& cache) {
+    PoolRegistry& registry = poolRegistry();
+    pthread_mutex_lock(&registry.lock);
+    for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+      if (registry.live.count(it->first) == 0) {
+        it = cache.entries.erase(it);
+      }
+      else {
+        it++;
+      }
+    }
+    pthread_mutex_unlock(&registry.lock);
+    cache.last = nullptr;
+    cache.sweepAt = 2 * cache.entries.size() > kSweepSize ? 2 * cache.entries.size() : kSweepSize;
+  }
+
+  CacheEntry& cacheEntry() {
+    ThreadCache& cache = threadCache();
+    if (cache.last != nullptr && cache.last->id == id) {
+      return *cache.last;
+    }
+    auto it = cache.entries.find(id);
+    if (it == cache.entries.end()) {
+      // First use of this pool by the thread, the only time the registry lock can be taken here
+      if (cache.entries.size() >= cache.sweepAt) {
+        sweep(cache);
+      }
+      it = cache.entries.emplace(id, CacheEntry()).first;
+      it->second.id = id;
+      it->second.pool = this;
+    }
+    cache.last = &it->second;
+    return it->second;
+  }
+
+  void pushBatch(FreeNode* head, int count) {
+    pthread_mutex_lock(&centralLock);
+    batches.push_back({head, count});
+    pthread_mutex_unlock(&centralLock);
+  }
+
+  /*
+    Refills an empty cache entry with a batch from the central list, carving a new chunk if needed
+  */
+  void refill(CacheEntry& e) {
+    pthread_mutex_lock(&centralLock);
+    if (!batches.empty()) {
+      Batch b = batches.back();
+      batches.pop_back();
+      pthread_mutex_unlock(&centralLock);
+      e.head = b.head;
+      e.count = b.count;
+      return;
+    }
+    FreeNode* chunk = new FreeNode[kBatch];
+    chunks.push_back(chunk);
+    pthread_mutex_unlock(&centralLock);
+    for (int i = 0; i < kBatch - 1; i++) {
+      chunk[i].next = &chunk[i + 1];
+    }
+    chunk[kBatch - 1].next = nullptr;
+    e.head = chunk;
+    e.count = kBatch;
+  }
+
+public:
+  NodePool() {
+    PoolRegistry& registry = poolRegistry();
+    id = registry.nextId.fetch_add(1);
+    pthread_mutex_init(&centralLock, nullptr);
+    pthread_mutex_lock(&registry.lock);
+    registry.live.insert(id);
+    pthread_mutex_unlock(&registry.lock);
+  }
+
+  ~NodePool() {
+    PoolRegistry& registry = poolRegistry();
+    pthread_mutex_lock(&registry.lock);
+    registry.live.erase(id);
+    pthread_mutex_unlock(&registry.lock);
+    // The calling thread's cache may still point into the arena, drop it
+    if (!cacheGone()) {
+      ThreadCache& cache = threadCache();
+      if (cache.last != nullptr && cache.last->id == id) {
+        cache.last = nullptr;
+      }
+      cache.entries.erase(id);
+    }
+    for (FreeNode* chunk : chunks) {
+      delete[] chunk;
+    }
+    pthread_mutex_destroy(&centralLock);
+  }
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  void* allocate() {
+    if (cacheGone()) {
+      // Thread is exiting, go straight to the central list
+      CacheEntry e;
+      refill(e);
+      if (e.count > 1) {
+        pushBatch(e.head->next, e.count - 1);
+      }
+      return e.head->storage;
+    }
+    CacheEntry& e = cacheEntry();
+    if (e.head == nullptr) {
+      refill(e);
+    }
+    FreeNode* n = e.head;
+    e.head = n->next;
+    e.count--;
+    return n->storage;
+  }
+
+  void deallocate(void* p) {
+    FreeNode* n = reinterpret_cast<FreeNode*>(p);
+    if (cacheGone()) {
+      n->next = nullptr;
+      pushBatch(n, 1);
+      return;
+    }
+    CacheEntry& e = cacheEntry();
+    n->next = e.head;
+    e.head = n;
+    e.count++;
+    // Producers allocate and consumers free, so surplus flows back to the central list in bulk
+    if (e.count >= 2 * kBatch) {
+      FreeNode* last = e.head;
+      for (int i = 1; i < kBatch; i++) {
+        last = last->next;
+      }
+      FreeNode* rest = last->next;
+      last->next = nullptr;
+      pushBatch(e.head, kBatch);
+      e.head = rest;
+      e.count -= kBatch;
+    }
+  }
+};
+
+#endif
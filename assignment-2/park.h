@@ -1,41 +1,231 @@
 #ifndef GARAGE_H
 #define GARAGE_H
 
+#include "cacheLine.h"
+#include "pthread.h"
 #include <iostream>
-#include <mutex>
 #include <atomic>
-#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
 #include <thread>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using namespace std;
 
+/*
+    Parking slot owned by a single thread, on its own cache line so wakers only touch the sleeper's line
+*/
+struct alignas(kCacheLineSize) ParkSlot {
+    atomic<uint32_t> state; // 1 while the owner intends to sleep, 0 once unparked
+    pthread_t tid;          // Owner of the slot
+
+    ParkSlot() : state(0), tid(pthread_self()) {}
+};
+
+inline ostream& operator<<(ostream& os, const ParkSlot* slot) {
+    return os << slot->tid;
+}
+
 class Garage {
 private:
-    unordered_map<pthread_t, atomic<bool>> flag_map;
+    static long futex(atomic<uint32_t>* addr, int op, uint32_t val, const timespec* timeout = nullptr) {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, timeout, nullptr, 0);
+    }
 
 public:
     Garage() = default;
     ~Garage() = default;
 
+    /*
+        Returns the calling thread's slot, registered on first use
+    */
+    static ParkSlot* self() {
+        thread_local ParkSlot slot;
+        return &slot;
+    }
+
     void setPark() {
-        pthread_t current_id = pthread_self();
-        atomic<bool>& flag = flag_map[current_id];
-        flag = false;
+        self()->state.store(1, memory_order_release);
+    }
+
+    void park() {
+        ParkSlot* slot = self();
+        // Loop to absorb spurious wakeups, returns right away if unpark already happened
+        while (slot->state.load(memory_order_acquire) == 1) {
+            futex(&slot->state, FUTEX_WAIT_PRIVATE, 1);
+        }
+    }
+
+    /*
+        Like park(), but gives up at deadline. Returns true if unparked, false on timeout,
+        in which case the caller must withdraw its setPark() before anyone can unpark it
+    */
+    bool parkUntil(chrono::steady_clock::time_point deadline) {
+        ParkSlot* slot = self();
+        while (slot->state.load(memory_order_acquire) == 1) {
+            chrono::nanoseconds remaining = deadline - chrono::steady_clock::now();
+            if (remaining.count() <= 0) {
+                return false;
+            }
+            timespec timeout;
+            timeout.tv_sec = remaining.count() / 1000000000;
+            timeout.tv_nsec = remaining.count() % 1000000000;
+            futex(&slot->state, FUTEX_WAIT_PRIVATE, 1, &timeout);
+        }
+        return true;
+    }
+
+    /*
+        Withdraws a setPark() of the calling thread that no unpark() will answer
+    */
+    void cancelPark() {
+        self()->state.store(0, memory_order_relaxed);
+    }
+
+    // The sleeper may return from park() before the wake call is made, a wake on a
+    // reused or unmapped slot is harmless since every sleeper re-checks its state
+    void unpark(ParkSlot* slot) {
+        slot->state.store(0, memory_order_release);
+        futex(&slot->state, FUTEX_WAKE_PRIVATE, 1);
+    }
+};
+
+/*
+    Threads parked until another thread publishes what they wait for
+    A waiter calls prepare(), re-checks its condition, then either park()s or withdraw()s. A publisher makes
+    its change visible, then calls notifyOne(). The two seq_cst fences make sure that either the waiter's
+    re-check sees the change or the publisher sees the waiter, and while nobody waits a notify costs a fence
+    and one load. unpark() only happens under the lock, so once withdraw() returns no wake for that park is
+    still on its way; the slot is shared with every other Garage, and a late wake could end a later park
+    somewhere else.
+*/
+class SleeperList {
+public:
+    /*
+        Entry of a waiting thread, lives on that thread's stack
+    */
+    struct Sleeper {
+        ParkSlot* slot;
+        Sleeper* next;
+
+        Sleeper() : slot(Garage::self()), next(nullptr) {}
+    };
+
+private:
+    atomic<int> count;    // Length of the list, read by notifiers without the lock, first so owners can put it on a hot line
+    bool newestFirst;     // Wake order, most recently parked first instead of oldest first
+    pthread_mutex_t lock; // Protects the list, only taken when a thread parks or has to be woken
+    Sleeper* head;        // Next to wake
+    Sleeper* tail;
+    Garage garage;
+
+    // Called while holding lock
+    void unlinkHead() {
+        Sleeper* first = head;
+        head = first->next;
+        if (head == nullptr) {
+            tail = nullptr;
+        }
+        count.fetch_sub(1, memory_order_relaxed);
+        garage.unpark(first->slot);
+    }
+
+public:
+    SleeperList(bool newestFirst = false) : count(0), newestFirst(newestFirst), head(nullptr), tail(nullptr) {
+        pthread_mutex_init(&lock, nullptr);
+    }
+
+    ~SleeperList() {
+        pthread_mutex_destroy(&lock);
+    }
+
+    SleeperList(const SleeperList&) = delete;
+    SleeperList& operator=(const SleeperList&) = delete;
+
+    /*
+        Adds the calling thread to the list and announces that it is about to park
+    */
+    void prepare(Sleeper& sleeper) {
+        garage.setPark();
+        pthread_mutex_lock(&lock);
+        if (head == nullptr) {
+            head = tail = &sleeper;
+        }
+        else if (newestFirst) {
+            sleeper.next = head;
+            head = &sleeper;
+        }
+        else {
+            tail->next = &sleeper;
+            tail = &sleeper;
+        }
+        count.fetch_add(1, memory_order_seq_cst);
+        pthread_mutex_unlock(&lock);
+        // Pairs with the fence in notifyOne()
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+
+    /*
+        Takes the calling thread off the list if it is still there, returns false if a notifier woke it first
+        A waiter that found what it waited for and gets false should pass the wake on with wakeOne()
+    */
+    bool withdraw(Sleeper& sleeper) {
+        pthread_mutex_lock(&lock);
+        Sleeper* prev = nullptr;
+        Sleeper* iter = head;
+        while (iter != nullptr && iter != &sleeper) {
+            prev = iter;
+            iter = iter->next;
+        }
+        if (iter != nullptr) {
+            (prev == nullptr ? head : prev->next) = iter->next;
+            if (tail == iter) {
+                tail = prev;
+            }
+            count.fetch_sub(1, memory_order_relaxed);
+            garage.cancelPark();
+        }
+        pthread_mutex_unlock(&lock);
+        return iter != nullptr;
     }
 
     void park() {
-        pthread_t current_id = pthread_self();
-        atomic<bool>& flag = flag_map[current_id];
+        garage.park();
+    }
+
+    /*
+        Returns false on timeout, the caller then withdraw()s, which fails if a wake came in the meantime
+    */
+    bool parkUntil(chrono::steady_clock::time_point deadline) {
+        return garage.parkUntil(deadline);
+    }
 
-        flag.wait(false);
+    void wakeOne() {
+        pthread_mutex_lock(&lock);
+        if (head != nullptr) {
+            unlinkHead();
+        }
+        pthread_mutex_unlock(&lock);
     }
 
-    void unpark(pthread_t id) {
-        auto it = flag_map.find(id);
-        if (it != flag_map.end()) {
-            it->second.store(true);
-            it->second.notify_one();
+    void wakeAll() {
+        pthread_mutex_lock(&lock);
+        while (head != nullptr) {
+            unlinkHead();
+        }
+        pthread_mutex_unlock(&lock);
+    }
 
+    /*
+        Wakes one waiter after the caller published a change, if any thread waits
+    */
+    void notifyOne() {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (count.load(memory_order_relaxed) > 0) {
+            wakeOne();
         }
     }
 };
@@ -2,67 +2,227 @@
 #define QUEUE_H
 
 #include "pthread.h"
+#include "nodePool.h"
+#include "park.h"
+#include "cacheLine.h"
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <utility>
 
 using namespace std;
 
+/*
+  List node, value is only alive in nodes holding an item, so the sentinel never constructs a T
+  The queue constructs and destroys value explicitly
+*/
 template<typename T>
 class Node {
 public:
-  T value;
-  Node* next;
+  union {
+    T value;
+  };
+  atomic<Node*> next; // Set by the enqueuer under tail_lock, read by dequeuers that only hold head_lock
+
+  Node() : next(nullptr) {}
 
-  Node() : value(T()), next(nullptr) {}
-  Node(T val) : value(val), next(nullptr) {}
+  template<typename... Args>
+  Node(in_place_t, Args&&... args) : value(forward<Args>(args)...), next(nullptr) {}
+
+  ~Node() {}
 };
 
 /*
   Michael and Scott Concurrent Queue
+  Nodes come from Allocator, by default a per-queue NodePool so steady state operations do not hit the heap
+  Padded = false packs the fields together instead of giving each group its own cache line, for benchmarks
 */
-template<typename T>
+template<typename T, typename Allocator = NodePool<Node<T>>, bool Padded = true>
 class Queue {
 
 private:
-  Node<T>* head;
-  Node<T>* tail;
+  // Dequeuers work on the first line and enqueuers on the second, so the two sides do not invalidate each other
+  alignas(kLineAlign<Node<T>*, Padded>) Node<T>* head;
   pthread_mutex_t head_lock;
+
+  alignas(kLineAlign<Node<T>*, Padded>) Node<T>* tail;
   pthread_mutex_t tail_lock;
+  SleeperList sleepers;       // Consumers parked in waitDequeue(), oldest first, enqueue reads its count on this line
+
+  alignas(kLineAlign<Allocator, Padded>) Allocator alloc; // Source of node memory
+
+  /*
+    Unlinks the oldest item and passes it to out as an rvalue, returns false if the queue is empty
+    The item's node becomes the new sentinel, so its value is destroyed right after out took it.
+  */
+  template<typename Out>
+  bool take(Out out) {
+    pthread_mutex_lock(&head_lock);
+    Node<T>* tmp = head;
+    Node<T>* new_head = tmp->next.load(memory_order_acquire);
+    if (new_head == nullptr) {
+      pthread_mutex_unlock(&head_lock);
+      return false;
+    }
+    out(move(new_head->value));
+    new_head->value.~T();
+    head = new_head;
+    pthread_mutex_unlock(&head_lock);
+    tmp->~Node<T>();
+    alloc.deallocate(tmp);
+    return true;
+  }
 
 public:
   Queue() {
-    Node<T>* tmp = new Node<T>();
-    tmp->next = nullptr;
+    Node<T>* tmp = new (alloc.allocate()) Node<T>();
     head = tail = tmp;
     pthread_mutex_init(&head_lock, nullptr);
     pthread_mutex_init(&tail_lock, nullptr);
   }
 
-  void enqueue(T item) {
-    Node<T>* tmp = new Node<T>();
-    tmp->value = item;
-    tmp->next = nullptr;
+  // Assumes no other thread is still using the queue
+  ~Queue() {
+    Node<T>* iter = head;
+    while (iter != nullptr) {
+      Node<T>* next = iter->next;
+      if (iter != head) {
+        iter->value.~T();
+      }
+      iter->~Node<T>();
+      alloc.deallocate(iter);
+      iter = next;
+    }
+    pthread_mutex_destroy(&head_lock);
+    pthread_mutex_destroy(&tail_lock);
+  }
+
+  Queue(const Queue&) = delete;
+  Queue& operator=(const Queue&) = delete;
+
+  void enqueue(const T& item) {
+    emplace(item);
+  }
+
+  void enqueue(T&& item) {
+    emplace(move(item));
+  }
+
+  /*
+    Constructs the new item in place from args
+  */
+  template<typename... Args>
+  void emplace(Args&&... args) {
+    Node<T>* tmp = new (alloc.allocate()) Node<T>(in_place, forward<Args>(args)...);
     pthread_mutex_lock(&tail_lock);
-    tail->next = tmp;
+    tail->next.store(tmp, memory_order_release);
     tail = tmp;
     pthread_mutex_unlock(&tail_lock);
-  };
+    // While consumers keep up nobody sleeps, and a fence and a load are all the blocking support costs
+    sleepers.notifyOne();
+  }
 
   T dequeue() {
-    pthread_mutex_lock(&head_lock);
-    Node<T>* tmp = head;
-    Node<T>* new_head = tmp->next;
-    if (new_head == nullptr) {
-      pthread_mutex_unlock(&head_lock);
+    optional<T> value;
+    if (!take([&value](T&& item) { value.emplace(move(item)); })) {
       throw out_of_range("Attempt to dequeue from an empty queue");
     }
-    T value = new_head->value;
-    head = new_head;
-    pthread_mutex_unlock(&head_lock);
-    free(tmp);
-    return value;
+    return move(*value);
   };
 
+  /*
+    Moves the oldest item into item and removes it, returns false instead of throwing if the queue is empty
+  */
+  bool tryDequeue(T& item) {
+    return take([&item](T&& oldest) { item = move(oldest); });
+  }
+
+  /*
+    Moves the oldest item into item, parking the calling thread while the queue is empty
+  */
+  void waitDequeue(T& item) {
+    while (!tryDequeue(item)) {
+      SleeperList::Sleeper sleeper;
+      sleepers.prepare(sleeper);
+      // An item enqueued before the sleeper was visible did not wake anyone
+      if (tryDequeue(item)) {
+        if (!sleepers.withdraw(sleeper)) {
+          sleepers.wakeOne(); // Pass on the wake meant for this thread, it may be the only one for an item still queued
+        }
+        return;
+      }
+      sleepers.park();
+    }
+  }
+
+  /*
+    Like waitDequeue(), but gives up after timeout, returns false if no item arrived in time
+  */
+  template<class Rep, class Period>
+  bool waitDequeueFor(T& item, const chrono::duration<Rep, Period>& timeout) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(timeout);
+    while (!tryDequeue(item)) {
+      SleeperList::Sleeper sleeper;
+      sleepers.prepare(sleeper);
+      if (tryDequeue(item)) {
+        if (!sleepers.withdraw(sleeper)) {
+          sleepers.wakeOne();
+        }
+        return true;
+      }
+      if (!sleepers.parkUntil(deadline) && sleepers.withdraw(sleeper)) {
+        return tryDequeue(item);
+      }
+    }
+    return true;
+  }
+
+  /*
+    Copies the oldest item into item without removing it, returns false if the queue is empty
+  */
+  bool front(T& item) {
+    pthread_mutex_lock(&head_lock);
+    Node<T>* first = head->next.load(memory_order_acquire);
+    if (first != nullptr) {
+      item = first->value;
+    }
+    pthread_mutex_unlock(&head_lock);
+    return first != nullptr;
+  }
+
+  /*
+    Removes the oldest item matching pred from anywhere in the queue, returns false if there is none
+  */
+  template<typename Pred>
+  bool removeIf(Pred pred) {
+    pthread_mutex_lock(&head_lock);
+    pthread_mutex_lock(&tail_lock);
+    Node<T>* prev = head;
+    Node<T>* iter = head->next;
+    while (iter != nullptr && !pred(iter->value)) {
+      prev = iter;
+      iter = iter->next;
+    }
+    if (iter != nullptr) {
+      prev->next.store(iter->next.load(memory_order_relaxed), memory_order_relaxed);
+      if (iter == tail) {
+        tail = prev;
+      }
+    }
+    pthread_mutex_unlock(&tail_lock);
+    pthread_mutex_unlock(&head_lock);
+    if (iter == nullptr) {
+      return false;
+    }
+    iter->value.~T();
+    iter->~Node<T>();
+    alloc.deallocate(iter);
+    return true;
+  }
+
   bool isEmpty() {
     return head == tail;
   }
@@ -0,0 +1,174 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include "cacheLine.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sched.h>
+#include <stdexcept>
+
+using namespace std;
+
+/*
+  Bounded multi-producer/multi-consumer queue on a ring of sequence-numbered slots (Vyukov)
+  Each slot's sequence number tells whose turn it is: a slot is free for the producer holding ticket
+  pos when its sequence is pos, and ready for the consumer holding ticket pos when it is pos + 1.
+  Producers and consumers claim tickets with one CAS on their own counter, so they only meet on the
+  slots themselves. The bulk operations claim a run of consecutive slots with a single CAS.
+*/
+template<typename T>
+class RingQueue {
+
+private:
+  struct Slot {
+    atomic<size_t> seq;
+    T value;
+  };
+
+  unique_ptr<Slot[]> slots;
+  size_t mask; // Capacity - 1, capacity is a power of two
+  alignas(kCacheLineSize) atomic<size_t> enqueuePos; // Next producer ticket
+  alignas(kCacheLineSize) atomic<size_t> dequeuePos; // Next consumer ticket
+
+  /*
+    Claims up to n consecutive tickets from pos whose slots are in state pos + offset, returns how many
+    A slot in the expected state stays in it until the owner of its ticket moves it on, so after the CAS
+    every claimed slot is still usable.
+  */
+  size_t claim(atomic<size_t>& counter, size_t offset, size_t n, size_t& first) {
+    if (n == 0) {
+      return 0;
+    }
+    size_t pos = counter.load(memory_order_relaxed);
+    while (true) {
+      size_t count = 0;
+      while (count < n && slots[(pos + count) & mask].seq.load(memory_order_acquire) == pos + count + offset) {
+        count++;
+      }
+      if (count == 0) {
+        size_t seq = slots[pos & mask].seq.load(memory_order_acquire);
+        // Behind pos means the queue is full (producers) or empty (consumers), ahead means pos is stale
+        if ((intptr_t)(seq - (pos + offset)) < 0) {
+          return 0;
+        }
+        pos = counter.load(memory_order_relaxed);
+        continue;
+      }
+      if (counter.compare_exchange_weak(pos, pos + count, memory_order_relaxed)) {
+        first = pos;
+        return count;
+      }
+    }
+  }
+
+public:
+  /*
+    capacity is rounded up to a power of two
+  */
+  RingQueue(size_t capacity = 1024) : enqueuePos(0), dequeuePos(0) {
+    if (capacity == 0) {
+      throw invalid_argument("Ring capacity must be positive.");
+    }
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots.reset(new Slot[size]);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+      slots[i].seq.store(i, memory_order_relaxed);
+    }
+  }
+
+  RingQueue(const RingQueue&) = delete;
+  RingQueue& operator=(const RingQueue&) = delete;
+
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+  /*
+    Adds item unless the queue is full, never waits
+  */
+  bool tryEnqueue(const T& item) {
+    return enqueueBulk(&item, 1) == 1;
+  }
+
+  /*
+    Adds item, yielding while the queue is full
+  */
+  void enqueue(T item) {
+    while (!tryEnqueue(item)) {
+      sched_yield();
+    }
+  }
+
+  /*
+    Copies the oldest item into item and removes it, returns false if the queue is empty
+  */
+  bool tryDequeue(T& item) {
+    return dequeueBulk(&item, 1) == 1;
+  }
+
+  T dequeue() {
+    T value;
+    if (!tryDequeue(value)) {
+      throw out_of_range("Attempt to dequeue from an empty queue");
+    }
+    return value;
+  }
+
+  /*
+    Adds up to n items from items in order, returns how many fit
+  */
+  size_t enqueueBulk(const T* items, size_t n) {
+    size_t pos;
+    size_t count = claim(enqueuePos, 0, n, pos);
+    for (size_t i = 0; i < count; i++) {
+      Slot& slot = slots[(pos + i) & mask];
+      slot.value = items[i];
+      slot.seq.store(pos + i + 1, memory_order_release);
+    }
+    return count;
+  }
+
+  /*
+    Moves up to max of the oldest items into items in order, returns how many there were
+  */
+  size_t dequeueBulk(T* items, size_t max) {
+    size_t pos;
+    size_t count = claim(dequeuePos, 1, max, pos);
+    for (size_t i = 0; i < count; i++) {
+      Slot& slot = slots[(pos + i) & mask];
+      items[i] = move(slot.value);
+      // Free the slot for the producer one lap ahead
+      slot.seq.store(pos + i + mask + 1, memory_order_release);
+    }
+    return count;
+  }
+
+  bool isEmpty() {
+    size_t pos = dequeuePos.load(memory_order_acquire);
+    return slots[pos & mask].seq.load(memory_order_acquire) != pos + 1;
+  }
+
+  // Not safe to call concurrently with the other methods
+  void print() {
+    size_t begin = dequeuePos.load();
+    size_t end = enqueuePos.load();
+    if (begin == end) {
+      cout << "Empty\n";
+      return;
+    }
+    for (size_t pos = begin; pos < end; pos++) {
+      cout << slots[pos & mask].value << (pos + 1 < end ? " " : "\n");
+    }
+  }
+
+
+};
+
+#endif
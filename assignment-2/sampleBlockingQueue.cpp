@@ -0,0 +1,44 @@
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+#include <chrono>
+#include <queue.h>
+using namespace std;
+
+Queue<long> q;
+
+void* consumer(void* arg) { 
+    long id = (long) arg;
+    long item;
+    // Sleeps in waitDequeue until the producer has something, -1 ends the thread
+    while (true) {
+        q.waitDequeue(item);
+        if (item < 0)
+            break;
+        printf("Consumer %ld got item %ld\n", id, item);
+    }
+    return NULL;
+}
+
+
+int main() {
+    printf("Hello, from main.\n");
+    pthread_t c1, c2;
+    pthread_create(&c1, NULL, consumer, (void*)1);
+    pthread_create(&c2, NULL, consumer, (void*)2);
+    for (long i = 0; i < 6; i++) {
+        usleep(100000);
+        q.enqueue(i);
+    }
+    q.enqueue(-1);
+    q.enqueue(-1);
+    pthread_join(c1, NULL);
+    pthread_join(c2, NULL);
+    // Nothing else is coming, so this times out
+    long item;
+    if (!q.waitDequeueFor(item, chrono::milliseconds(100)))
+        printf("Main timed out waiting for another item\n");
+    printf("Threads terminated. Resulting queue state:\n");
+    q.print();
+    return 0;
+}
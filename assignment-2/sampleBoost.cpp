@@ -0,0 +1,109 @@
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <chrono>
+#include "MLFQmutex.h"
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <unistd.h>
+using namespace std;
+
+/*
+  Wait time of threads that hold the lock longer than the quantum, while short threads keep the top levels busy.
+  Runs once without boosting, once with priority boost and once with aging.
+  Usage: ./sampleBoost [trace.json], the trace of the boost run is written as Chrome trace JSON if a file is given
+*/
+
+MLFQMutex* _lock;
+bool stopShort = false; // Protected by _lock
+pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+vector<double> longWaits; // Wait times in seconds of the long threads
+
+void busy(double seconds) {
+    chrono::steady_clock::time_point end = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    while (chrono::steady_clock::now() < end)
+        ;
+}
+
+void* shortWorker(void* args) {
+    while (true) {
+        _lock->lock();
+        bool stop = stopShort;
+        busy(0.0002);
+        _lock->unlock();
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+void* longWorker(void* args) {
+    vector<double> waits;
+    for (int i = 0; i < 10; i++) {
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        _lock->lock();
+        waits.push_back(chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now() - begin).count());
+        busy(0.003);
+        _lock->unlock();
+    }
+    pthread_mutex_lock(&statsLock);
+    longWaits.insert(longWaits.end(), waits.begin(), waits.end());
+    pthread_mutex_unlock(&statsLock);
+    return NULL;
+}
+
+double percentile(vector<double>& values, double p) {
+    size_t index = (size_t)(p * (values.size() - 1));
+    return values[index];
+}
+
+void run(const char* name, double boostInterval, double agingThreshold, const char* traceFile = NULL) {
+    _lock = new MLFQMutex(4, 0.001);
+    _lock->setVerbose(false);
+    if (traceFile != NULL)
+        _lock->enableTrace(1 << 16);
+    _lock->setBoostInterval(boostInterval);
+    _lock->setAgingThreshold(agingThreshold);
+    stopShort = false;
+    longWaits.clear();
+
+    vector<pthread_t> shortThreads, longThreads;
+    for (long i = 0; i < 4; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, shortWorker, NULL);
+        shortThreads.push_back(thread);
+    }
+    for (long i = 0; i < 2; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, longWorker, NULL);
+        longThreads.push_back(thread);
+    }
+    for (int i = 0; i < longThreads.size(); i++) {
+        pthread_join(longThreads[i], NULL);
+    }
+    _lock->lock();
+    stopShort = true;
+    _lock->unlock();
+    for (int i = 0; i < shortThreads.size(); i++) {
+        pthread_join(shortThreads[i], NULL);
+    }
+
+    sort(longWaits.begin(), longWaits.end());
+    printf("%s: long thread wait p50 %.4f s, p99 %.4f s, p99.9 %.4f s, max %.4f s\n", name,
+        percentile(longWaits, 0.5), percentile(longWaits, 0.99), percentile(longWaits, 0.999), longWaits.back());
+    _lock->stats().print(cout);
+    if (traceFile != NULL) {
+        ofstream out(traceFile);
+        _lock->exportChromeTrace(out);
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    run("no boost", 0, 0);
+    run("boost every 20ms", 0.02, 0, argc > 1 ? argv[1] : NULL);
+    run("aging after 10ms", 0, 0.01);
+    return 0;
+}
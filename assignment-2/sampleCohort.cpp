@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <chrono>
+#include "MLFQmutex.h"
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+using namespace std;
+
+
+// One level with a long quantum, so every thread stays at level 0 and only the cohort policy reorders them
+MLFQMutex _lock(1, 1);
+
+// Threads A to G queue in this order behind main, which runs on node 0, each on its made-up NUMA node
+const int numThreads = 7;
+const int nodes[numThreads] = {0, 1, 0, 1, 0, 0, 1};
+
+// With a limit of 2: A is the head and on main's node, which is plain FIFO order and does not count.
+// C then E skip ahead of B and D, which uses up the limit, so E hands the lock to B, the head.
+// B gives it to D, the head again, and D may skip ahead of F to G on its own node.
+const string expectedFifo = "ABCDEFG";
+const string expectedCohort = "ACEBDGF";
+
+string order;
+
+void* worker(void* args) {
+    long id = (long) args;
+    numaNodeOverride() = nodes[id];
+    _lock.lock();
+    order += (char)('A' + id);
+    _lock.unlock();
+    return NULL;
+}
+
+/*
+  Queues the threads one by one behind main, then releases the lock and returns the order they got it in
+*/
+string run(int cohortLimit) {
+    _lock.setNumaCohort(cohortLimit);
+    order = "";
+    _lock.lock();
+    vector<pthread_t> threads;
+    for (long i = 0; i < numThreads; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, worker, (void*)i);
+        threads.push_back(thread);
+        usleep(50000); // Let it queue before the next one starts
+    }
+    _lock.unlock();
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return order;
+}
+
+
+int main() {
+    _lock.setVerbose(false);
+    numaNodeOverride() = 0;
+
+    string fifo = run(0);
+    printf("Cohort limit 0: %s (expected %s)\n", fifo.c_str(), expectedFifo.c_str());
+    string cohort = run(2);
+    printf("Cohort limit 2: %s (expected %s)\n", cohort.c_str(), expectedCohort.c_str());
+
+    bool ok = fifo == expectedFifo && cohort == expectedCohort;
+    printf(ok ? "Handoffs followed the cohort policy.\n" : "Unexpected handoff order.\n");
+    return ok ? 0 : 1;
+}
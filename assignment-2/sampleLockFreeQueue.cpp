@@ -0,0 +1,50 @@
+#include <iostream>
+#include <random>
+#include <pthread.h>
+#include <unistd.h>
+#include <lfqueue.h>
+#include <sched.h>
+#include <atomic>
+using namespace std;
+
+LockFreeQueue<pthread_t> q;
+atomic<long> dequeued(0);
+
+void* enq(void* arg) { 
+    pthread_t base = (pthread_t) arg;
+    printf("Thread with base: %ld started.\n",base);
+    for (int i = base; i < base+100; i++)
+        q.enqueue(i);
+    return NULL;
+
+}
+
+void* deq(void* arg) {
+    // Race with the producers, dequeue 50 items in total
+    while (dequeued.load() < 50) {
+        try {
+            q.dequeue();
+            dequeued++;
+        } catch (const out_of_range&) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+
+int main() {
+    printf("Hello, from main.\n");
+    pthread_t e1, e2, d1;
+    pthread_create(&e1, NULL, enq, (void*)0);
+    pthread_create(&e2, NULL, enq, (void*)100);
+    pthread_create(&d1, NULL, deq, NULL);
+    pthread_join(e1, NULL);
+    pthread_join(e2, NULL);
+    pthread_join(d1, NULL);
+    for (int i=0; i < 50; i++)
+        int x = q.dequeue();
+    printf("Threads terminated. Resulting queue state:\n");
+    q.print();
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <chrono>
+#include "MLFQmutex.h"
+#include <semaphore.h>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+using namespace std;
+
+
+// 4096 levels of 10 microseconds each, so a critical section of t microseconds demotes a thread by about t / 10 levels
+MLFQMutex _lock(4096, 10e-6);
+
+// Critical section of each thread in its first run, and the level group it should land in
+// Levels 0, ~100, ~2000 and 4095 sit in the first, second, 32nd and last word of the level bitmap
+const int numThreads = 4;
+const long holdMicros[numThreads] = {100000, 20000, 0, 1000};
+const int expectedRank[numThreads] = {3, 2, 0, 1}; // Position in the handoff order, lowest level first
+
+sem_t demoted;
+sem_t go;
+int order[numThreads];
+int acquired = 0;
+
+void* worker(void* args) {
+    long id = (long) args;
+    // Demote this thread by holding the lock for its critical section once
+    _lock.lock();
+    usleep(holdMicros[id]);
+    _lock.unlock();
+    sem_post(&demoted);
+
+    // Queue behind main at the level just earned
+    sem_wait(&go);
+    _lock.lock();
+    printf("Thread with program ID %ld (first critical section %ld us) acquired lock\n", id, holdMicros[id]);
+    order[acquired++] = id;
+    _lock.unlock();
+    return NULL;
+}
+
+
+int main() {
+    try {
+        MLFQMutex tooMany(4097, 1);
+    } catch (const invalid_argument& e) {
+        printf("4097 levels rejected: %s\n", e.what());
+    }
+    _lock.setVerbose(false);
+    sem_init(&demoted, 0, 0);
+    sem_init(&go, 0, 0);
+
+    vector<pthread_t> threads;
+    for (long i = 0; i < numThreads; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, worker, (void*)i);
+        threads.push_back(thread);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        sem_wait(&demoted);
+    }
+
+    // Hold the lock until every thread waits in its level's queue, then hand it over
+    _lock.lock();
+    for (int i = 0; i < numThreads; i++) {
+        sem_post(&go);
+    }
+    usleep(200000);
+    _lock.unlock();
+
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    bool ok = true;
+    for (int i = 0; i < numThreads; i++) {
+        ok = ok && expectedRank[order[i]] == i;
+    }
+    printf(ok ? "Threads got the lock from the highest to the lowest priority level.\n" : "Unexpected handoff order.\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <random>
+#include <pthread.h>
+#include <unistd.h>
+#include <ringQueue.h>
+#include <sched.h>
+#include <atomic>
+using namespace std;
+
+RingQueue<pthread_t> q(256);
+atomic<long> dequeued(0);
+
+void* enq(void* arg) { 
+    pthread_t base = (pthread_t) arg;
+    printf("Thread with base: %ld started.\n",base);
+    // Enqueue in batches of 10
+    pthread_t batch[10];
+    for (int i = base; i < base+100; i += 10) {
+        for (int j = 0; j < 10; j++)
+            batch[j] = i + j;
+        // A full queue takes only part of the batch, retry the rest once a consumer made room
+        size_t sent = q.enqueueBulk(batch, 10);
+        if (sent < 10)
+            printf("Thread with base: %ld, queue full, retrying %zu items of the batch.\n", base, 10 - sent);
+        while (sent < 10) {
+            sched_yield();
+            sent += q.enqueueBulk(batch + sent, 10 - sent);
+        }
+    }
+    return NULL;
+
+}
+
+void* deq(void* arg) {
+    // Race with the producers, dequeue 50 items in total
+    pthread_t batch[8];
+    while (dequeued.load() < 50) {
+        long want = 50 - dequeued.load();
+        size_t n = q.dequeueBulk(batch, want < 8 ? want : 8);
+        if (n == 0)
+            sched_yield();
+        dequeued += n;
+    }
+    return NULL;
+}
+
+
+int main() {
+    printf("Hello, from main.\n");
+    pthread_t e1, e2, d1;
+    pthread_create(&e1, NULL, enq, (void*)0);
+    pthread_create(&e2, NULL, enq, (void*)100);
+    pthread_create(&d1, NULL, deq, NULL);
+    pthread_join(e1, NULL);
+    pthread_join(e2, NULL);
+    pthread_join(d1, NULL);
+    pthread_t x;
+    for (int i=0; i < 50; i++)
+        q.tryDequeue(x);
+    printf("Threads terminated. Resulting queue state:\n");
+    q.print();
+    return 0;
+}
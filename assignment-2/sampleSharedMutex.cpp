@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <chrono>
+#include "MLFQsharedMutex.h"
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <unistd.h>
+using namespace std;
+
+
+MLFQSharedMutex _lock(3, 1); // number of levels in MLFQ and time span for each level
+atomic<int> activeReaders(0);
+
+void* reader(void* args) { 
+    long id = (long) args;
+    for (int i = 0; i < 2; i++) {
+        _lock.lock_shared();
+        int active = ++activeReaders;
+        printf("Reader with program ID %ld acquired lock, %d readers inside\n", id, active);
+        sleep(1);
+        activeReaders--;
+        printf("Reader with program ID %ld releasing lock\n", id);
+        _lock.unlock_shared();
+    }
+    return NULL;
+}
+
+void* writer(void* args) { 
+    long id = (long) args;
+    for (int i = 0; i < 2; i++) {
+        _lock.lock();
+        printf("Writer with program ID %ld acquired lock, %d readers inside\n", id, activeReaders.load());
+        sleep(1);
+        printf("Writer with program ID %ld releasing lock\n", id);
+        _lock.unlock();
+    }
+    return NULL;
+}
+
+
+int main() {
+
+    vector<pthread_t> threads;
+    chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+
+    for (long i = 0; i < 5; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, i == 2 ? writer : reader, (void*)i);
+        threads.push_back(thread);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+    double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+    cout<<"Threads terminated. Total duration is: "<< duration<<" seconds."<<endl;
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <threadPool.h>
+using namespace std;
+
+ThreadPool pool(4);
+
+// Sums [begin, end) by splitting it into pool tasks, the halves are stolen by idle workers
+long sum(long begin, long end) {
+    if (end - begin <= 100000) {
+        long s = 0;
+        for (long i = begin; i < end; i++)
+            s += i;
+        return s;
+    }
+    long mid = begin + (end - begin) / 2;
+    future<long> left = pool.submit(sum, begin, mid);
+    long right = sum(mid, end);
+    return pool.wait(left) + right;
+}
+
+
+int main() {
+    printf("Hello, from main.\n");
+    chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+    vector<future<long>> results;
+    for (long i = 0; i < 8; i++) {
+        results.push_back(pool.submit([](long id) {
+            printf("Task %ld running on thread ID %ld\n", id, pthread_self());
+            usleep(100000);
+            return id * id;
+        }, i));
+    }
+    for (int i = 0; i < results.size(); i++)
+        printf("Task %d returned %ld\n", i, results[i].get());
+    // The recursion waits for its halves with pool.wait(), so waiting tasks keep their workers busy
+    printf("Sum of 0..9999999 is %ld\n", pool.submit(sum, 0, 10000000).get());
+    chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+    double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+    cout<<"Tasks finished. Total duration is: "<< duration<<" seconds."<<endl;
+    return 0;
+}
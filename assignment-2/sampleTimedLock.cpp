@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+#include <pthread.h>
+#include <chrono>
+#include "MLFQmutex.h"
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+using namespace std;
+
+
+MLFQMutex _lock(3, 1); // number of levels in MLFQ and time span for each level
+
+void* holder(void* args) { 
+    lock_guard<MLFQMutex> guard(_lock);
+    printf("Holder with thread ID %ld acquired lock, keeping it for 2 seconds\n", pthread_self());
+    sleep(2);
+    printf("Holder with thread ID %ld releasing lock\n", pthread_self());
+    return NULL;
+}
+
+void* impatient(void* args) { 
+    long id = (long) args;
+    // Waiters with a shorter timeout than the holder's critical section give up, the others get the lock
+    double timeout = id * 0.75;
+    unique_lock<MLFQMutex> guard(_lock, chrono::duration<double>(timeout));
+    if (guard.owns_lock()) {
+        printf("Thread with program ID %ld and timeout %.2f s acquired lock\n", id, timeout);
+    }
+    else {
+        printf("Thread with program ID %ld and timeout %.2f s gave up\n", id, timeout);
+    }
+    return NULL;
+}
+
+
+int main() {
+
+    vector<pthread_t> threads;
+    chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, holder, NULL);
+    threads.push_back(thread);
+    usleep(100000);
+    printf("try_lock while held: %s\n", _lock.try_lock() ? "acquired" : "busy");
+
+    for (long i = 1; i <= 4; i++) {
+        pthread_create(&thread, NULL, impatient, (void*)i);
+        threads.push_back(thread);
+    }
+
+    for (int i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    chrono::high_resolution_clock::time_point end = chrono::high_resolution_clock::now();
+    double duration = chrono::duration_cast<chrono::duration<double>>(end - begin).count();
+    _lock.stats().print(cout);
+    cout<<"Threads terminated. Total duration is: "<< duration<<" seconds."<<endl;
+    return 0;
+}
@@ -0,0 +1,153 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "cacheLine.h"
+#include <atomic>
+#include <cstdint>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Hint to the CPU that this is a spin-wait loop
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Spins before handing the CPU back, so a preempted lock holder gets to run when threads outnumber cores
+static const int kSpinsBeforeYield = 1024;
+
+// Spinning cannot help on a single CPU, the thread we wait for is not running
+inline int spinLimit() {
+  static const int limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? kSpinsBeforeYield : 0;
+  return limit;
+}
+
+/*
+  Test-and-set spinlock, every waiter spins on the same cache line
+*/
+class TASLock {
+private:
+  atomic_flag flag = ATOMIC_FLAG_INIT;
+
+public:
+  void lock() {
+    int spins = 0;
+    while (flag.test_and_set(memory_order_acquire)) {
+      cpuRelax();
+      if (++spins == kSpinsBeforeYield) {
+        spins = 0;
+        sched_yield();
+      }
+    }
+  }
+
+  void unlock() {
+    flag.clear(memory_order_release);
+  }
+};
+
+/*
+  Ticket lock, FIFO like MCS but every waiter spins on the shared now-serving counter
+*/
+class TicketLock {
+private:
+  atomic<uint32_t> nextTicket{0}; // Ticket handed to the next arriving thread
+  atomic<uint32_t> nowServing{0}; // Ticket of the thread allowed to hold the lock
+
+public:
+  void lock() {
+    uint32_t ticket = nextTicket.fetch_add(1, memory_order_relaxed);
+    int spins = 0;
+    while (nowServing.load(memory_order_acquire) != ticket) {
+      cpuRelax();
+      if (++spins >= spinLimit()) {
+        spins = 0;
+        sched_yield(); // The thread whose turn it is may be preempted
+      }
+    }
+  }
+
+  void unlock() {
+    nowServing.store(nowServing.load(memory_order_relaxed) + 1, memory_order_release);
+  }
+};
+
+/*
+  MCS queue lock (Mellor-Crummey and Scott, 1991)
+  Each waiter spins on the flag of its own queue node, and the lock is handed over in FIFO order.
+  A waiter that spins for too long sleeps on its node, otherwise a preempted waiter at the front
+  of the queue would stall everyone behind it when threads outnumber cores.
+*/
+class MCSLock {
+public:
+  static const uint32_t kGranted = 0;
+  static const uint32_t kSpinning = 1;
+  static const uint32_t kSleeping = 2;
+
+  struct alignas(kCacheLineSize) Node {
+    atomic<Node*> next;
+    atomic<uint32_t> state;
+  };
+
+private:
+  atomic<Node*> tail{nullptr}; // Last waiter in the queue, nullptr if the lock is free
+
+  static long futex(atomic<uint32_t>* addr, int op, uint32_t val) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, nullptr, nullptr, 0);
+  }
+
+public:
+  void lock(Node& node) {
+    node.next.store(nullptr, memory_order_relaxed);
+    node.state.store(kSpinning, memory_order_relaxed);
+    Node* prev = tail.exchange(&node, memory_order_acq_rel);
+    if (prev == nullptr) {
+      return; // Lock was free
+    }
+    prev->next.store(&node, memory_order_release);
+    for (int spins = 0; spins < spinLimit(); spins++) {
+      if (node.state.load(memory_order_acquire) == kGranted) {
+        return;
+      }
+      cpuRelax();
+    }
+    uint32_t expected = kSpinning;
+    if (node.state.compare_exchange_strong(expected, kSleeping, memory_order_acq_rel)) {
+      while (node.state.load(memory_order_acquire) != kGranted) {
+        futex(&node.state, FUTEX_WAIT_PRIVATE, kSleeping);
+      }
+    }
+  }
+
+  void unlock(Node& node) {
+    Node* next = node.next.load(memory_order_acquire);
+    if (next == nullptr) {
+      Node* expected = &node;
+      if (tail.compare_exchange_strong(expected, nullptr, memory_order_acq_rel, memory_order_relaxed)) {
+        return; // No one is waiting
+      }
+      // A new waiter swapped itself into tail but has not linked behind us yet
+      int spins = 0;
+      while ((next = node.next.load(memory_order_acquire)) == nullptr) {
+        if (++spins > spinLimit()) {
+          sched_yield(); // It was likely preempted in between, let it run
+        }
+        else {
+          cpuRelax();
+        }
+      }
+    }
+    if (next->state.exchange(kGranted, memory_order_acq_rel) == kSleeping) {
+      futex(&next->state, FUTEX_WAKE_PRIVATE, 1);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "cacheLine.h"
+#include "park.h"
+#include "queue.h"
+#include "pthread.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+  Unit of work run by a ThreadPool worker
+*/
+struct PoolTask {
+  virtual ~PoolTask() {}
+  virtual void run() = 0;
+};
+
+template<typename F>
+struct PoolTaskImpl : PoolTask {
+  F f;
+
+  PoolTaskImpl(F&& fn) : f(move(fn)) {}
+
+  void run() override {
+    f();
+  }
+};
+
+/*
+  Chase-Lev work-stealing deque (Chase and Lev, 2005, with the C11 orderings of Le et al., 2013)
+  The owning worker pushes and pops at the bottom, other workers steal from the top. Only a steal
+  and the owner's pop of the last item race, and they settle it with one CAS on top.
+*/
+template<typename T>
+class ChaseLevDeque {
+private:
+  struct Array {
+    int64_t size; // Power of two
+    unique_ptr<atomic<T>[]> items;
+
+    Array(int64_t n) : size(n), items(new atomic<T>[n]) {}
+
+    T get(int64_t i) {
+      return items[i & (size - 1)].load(memory_order_relaxed);
+    }
+
+    void put(int64_t i, T item) {
+      items[i & (size - 1)].store(item, memory_order_relaxed);
+    }
+  };
+
+  alignas(kCacheLineSize) atomic<int64_t> top;    // Next item to steal
+  alignas(kCacheLineSize) atomic<int64_t> bottom; // Next free slot of the owner
+  atomic<Array*> array;
+  vector<unique_ptr<Array>> arrays;   // Every array ever used, a thief may still read an old one
+
+  Array* grow(Array* a, int64_t t, int64_t b) {
+    arrays.emplace_back(new Array(a->size * 2));
+    Array* bigger = arrays.back().get();
+    for (int64_t i = t; i < b; i++) {
+      bigger->put(i, a->get(i));
+    }
+    array.store(bigger, memory_order_release);
+    return bigger;
+  }
+
+public:
+  ChaseLevDeque(int64_t capacity = 256) : top(0), bottom(0) {
+    int64_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    arrays.emplace_back(new Array(size));
+    array.store(arrays.back().get(), memory_order_relaxed);
+  }
+
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  // Owner only
+  void push(T item) {
+    int64_t b = bottom.load(memory_order_relaxed);
+    int64_t t = top.load(memory_order_acquire);
+    Array* a = array.load(memory_order_relaxed);
+    if (b - t > a->size - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    bottom.store(b + 1, memory_order_release); // Publishes the item to thieves that read bottom with acquire
+  }
+
+  // Owner only, returns false if the deque is empty
+  bool pop(T& item) {
+    int64_t b = bottom.load(memory_order_relaxed) - 1;
+    Array* a = array.load(memory_order_relaxed);
+    bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = top.load(memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, memory_order_relaxed);
+      return false;
+    }
+    item = a->get(b);
+    if (t == b) {
+      // Last item, a thief may be taking it at the same time
+      bool won = top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+      bottom.store(b + 1, memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread, returns false if the deque is empty or another thread took the top item first
+  bool steal(T& item) {
+    int64_t t = top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = bottom.load(memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    Array* a = array.load(memory_order_acquire);
+    item = a->get(t);
+    return top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+  }
+};
+
+/*
+  Fixed-size work-stealing thread pool
+  Each worker owns a Chase-Lev deque. Tasks submitted by a worker go to its own deque, others go to a shared
+  Queue. A worker runs its own tasks newest first, then takes from the shared queue, then steals the
+  oldest task of a randomly chosen worker. Workers with nothing to do park in the Garage until a submit
+  wakes one of them.
+*/
+class ThreadPool {
+private:
+  struct Worker {
+    ChaseLevDeque<PoolTask*> deque;
+    uint64_t rng; // xorshift state for picking victims
+    thread handle;
+  };
+
+  vector<unique_ptr<Worker>> workers;
+  Queue<PoolTask*> injected; // Tasks submitted from outside the pool
+  SleeperList sleepers;      // Parked workers, the most recently parked one is woken first, its caches are the warmest
+  atomic<bool> stopping;
+
+  struct Current {
+    ThreadPool* pool;
+    int index;
+  };
+
+  // Pool and index of the worker running on this thread, nullptr outside the pools
+  static Current& current() {
+    thread_local Current c = {nullptr, -1};
+    return c;
+  }
+
+  static uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  bool findTask(int index, PoolTask*& task) {
+    Worker& self = *workers[index];
+    if (self.deque.pop(task) || injected.tryDequeue(task)) {
+      return true;
+    }
+    int n = workers.size();
+    int start = nextRandom(self.rng) % n;
+    for (int i = 0; i < n; i++) {
+      int victim = (start + i) % n;
+      if (victim != index && workers[victim]->deque.steal(task)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /*
+    Parks the calling worker until a submit wakes it, unless it finds a task while it registers
+    Returns true with that task, false once woken or when the pool is stopping
+  */
+  bool idle(int index, PoolTask*& task) {
+    SleeperList::Sleeper sleeper;
+    sleepers.prepare(sleeper);
+    // A task scheduled before the sleeper was visible did not wake anyone
+    bool found = findTask(index, task);
+    if (found || stopping.load(memory_order_acquire)) {
+      if (!sleepers.withdraw(sleeper)) {
+        sleepers.wakeOne(); // The wake meant for this worker may be the only one for a task still queued
+      }
+      return found;
+    }
+    sleepers.park();
+    return false;
+  }
+
+  void run(int index) {
+    current() = {this, index};
+    PoolTask* task;
+    while (true) {
+      if (findTask(index, task) || idle(index, task)) {
+        task->run();
+        delete task;
+      }
+      else if (stopping.load(memory_order_acquire)) {
+        break;
+      }
+    }
+    current() = {nullptr, -1};
+  }
+
+  void schedule(PoolTask* task) {
+    Current& c = current();
+    if (c.pool == this) {
+      workers[c.index]->deque.push(task);
+    }
+    else {
+      injected.enqueue(task);
+    }
+    sleepers.notifyOne();
+  }
+
+public:
+  /*
+    Starts numThreads workers, one per online CPU by default
+  */
+  ThreadPool(int numThreads = 0) : sleepers(true), stopping(false) {
+    if (numThreads <= 0) {
+      numThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+    }
+    for (int i = 0; i < numThreads; i++) {
+      workers.emplace_back(new Worker());
+      workers[i]->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+    // Start the threads only once every deque exists, they steal from each other right away
+    for (int i = 0; i < numThreads; i++) {
+      workers[i]->handle = thread(&ThreadPool::run, this, i);
+    }
+  }
+
+  /*
+    Runs every task submitted so far, then stops the workers
+  */
+  ~ThreadPool() {
+    stopping.store(true, memory_order_release);
+    sleepers.wakeAll();
+    for (unique_ptr<Worker>& w : workers) {
+      w->handle.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int size() const {
+    return workers.size();
+  }
+
+  /*
+    Queues f(args...) and returns a future for its result, exceptions thrown by f are rethrown by get()
+    Tasks should wait for other tasks with wait(), a plain get() blocks the worker and can deadlock the pool.
+  */
+  template<typename F, typename... Args>
+  auto submit(F&& f, Args&&... args) -> future<invoke_result_t<decay_t<F>, decay_t<Args>...>> {
+    using R = invoke_result_t<decay_t<F>, decay_t<Args>...>;
+    // Tasks still running during shutdown may submit more work, nobody else may
+    if (stopping.load(memory_order_relaxed) && current().pool != this) {
+      throw logic_error("Submit to a stopping thread pool");
+    }
+    packaged_task<R()> job(bind(forward<F>(f), forward<Args>(args)...));
+    future<R> result = job.get_future();
+    schedule(new PoolTaskImpl<packaged_task<R()>>(move(job)));
+    return result;
+  }
+
+  /*
+    Returns the result of a task of this pool. On a worker it runs other tasks until the result is ready,
+    so a task waiting for its subtasks keeps its worker busy instead of blocking it.
+  */
+  template<typename R>
+  R wait(future<R>& result) {
+    Current& c = current();
+    if (c.pool == this) {
+      PoolTask* task;
+      while (result.wait_for(chrono::seconds(0)) != future_status::ready) {
+        if (findTask(c.index, task)) {
+          task->run();
+          delete task;
+        }
+        else {
+          sched_yield(); // The task is running on another worker
+        }
+      }
+    }
+    return result.get();
+  }
+};
+
+#endif
@@ -1,9 +1,14 @@
 #ifndef COURT_H
 #define COURT_H
 
+#include "CourtLog.h"
+#include "MatchBarrier.h"
 #include "pthread.h"
 #include "semaphore.h"
+#include <atomic>
+#include <cstdint>
 #include <exception>
+#include <stdexcept>
 #include "stdlib.h"
 #include "stdio.h"
 
@@ -14,95 +19,189 @@ class Court {
 
 private:
 
-  int numPlayers;             // number of players inside the court
-  int numWaiting;             // number of players waiting to enter the court
+  // Layout of state: players inside in the low bits, players waiting above them, match status in the top bit
+  static const uint64_t kPlayerUnit = 1;
+  static const uint64_t kWaitingUnit = 1ULL << 20;
+  static const uint64_t kCountMask = kWaitingUnit - 1;
+  static const uint64_t kMatchOngoing = 1ULL << 63;
+
+  /*
+    Player sleeping in enter() until a match ends, lives on that player's stack
+  */
+  struct Waiter {
+    sem_t wake;               // posted once the waiter has been given a place on the court
+    int place;                // number of players on the court including this one, set by the waker
+    Waiter* next;             // next waiter in arrival order
+  };
+
+  atomic<uint64_t> state;     // numPlayers, numWaiting and matchOngoing packed into one word
+  uint32_t courtId;           // identifies the court's events in the log
   int numPlayersNeeded;       // number of players (excluding referee) needed to start a match
   int refereeRequired;        // if a referee will take part in the court
-  bool matchOngoing;          // status of the match
-  pthread_t refereeId;        // id of the referee taking part in the court 
-  sem_t lockNumPlayers;       // binary semaphore (lock) for atomic modification of numPlayers
-  sem_t lockNumWaiting;       // binary semaphore (lock) for atomic modification of numWaiting
-  sem_t lockEnter;            // binary semaphore (lock) for synchronizing enter method body
-  sem_t lockMatchStatus;      // binary semaphore (lock) for atomic read/write operations on match status value
-  sem_t waitMatchEnd;         // semaphore for players waiting to enter the court
-  pthread_barrier_t barrier;  // barrier for synchronizing print statements
+  int matchSize;              // number of players (including referee) that starts a match
+  pthread_t refereeId;        // id of the referee taking part in the court, written by the referee before the barrier
+  sem_t lockWaiters;          // binary semaphore (lock) for the waiter queue and for changes to numWaiting
+  Waiter* waitersHead;        // oldest waiting player, admitted first
+  Waiter* waitersTail;        // most recently arrived waiting player
+  MatchBarrier barrier;       // barrier for ordering the log events of a match, one generation per wait
+
+  static int numPlayers(uint64_t s) {
+    return s & kCountMask;
+  }
+
+  static int numWaiting(uint64_t s) {
+    return (s >> 20) & kCountMask;
+  }
+
+  static bool matchOngoing(uint64_t s) {
+    return s & kMatchOngoing;
+  }
+
+  static uint32_t nextCourtId() {
+    static atomic<uint32_t> next(0);
+    return next.fetch_add(1, memory_order_relaxed);
+  }
+
+  /*
+    Queues the calling thread while a match is ongoing and sleeps until the last player of the match admits it
+    Returns true with the thread's place on the court, false if the match ended before the thread could queue
+  */
+  bool waitForPlace(int& place) {
+    Waiter self;
+    self.next = nullptr;
+    sem_init(&self.wake, 0, 0);
+
+    // Counting and queueing happen under the lock, so the last player sees every waiter it counts in the queue
+    sem_wait(&lockWaiters);
+    uint64_t s = state.load(memory_order_acquire);
+    while (matchOngoing(s) && !state.compare_exchange_weak(s, s + kWaitingUnit, memory_order_acq_rel, memory_order_acquire)) {
+    }
+    if (!matchOngoing(s)) {
+      sem_post(&lockWaiters);
+      sem_destroy(&self.wake);
+      return false;
+    }
+    if (waitersTail == nullptr) {
+      waitersHead = &self;
+    }
+    else {
+      waitersTail->next = &self;
+    }
+    waitersTail = &self;
+    sem_post(&lockWaiters);
+    CourtLog::instance().log(EventWait, courtId, pthread_self());
+
+    sem_wait(&self.wake); // Wait until the last player of the match hands this thread a place
+    sem_destroy(&self.wake);
+    place = self.place;
+    return true;
+  }
+
+  /*
+    Ends the match for the last player to leave, handing its places to the oldest waiting players
+    Only as many waiters as a match takes are woken, the rest stay asleep until the match they start ends
+  */
+  void admitWaiters(uint64_t s) {
+    // Nobody is waiting, clear the word unless a player queues meanwhile
+    while (numWaiting(s) == 0) {
+      if (state.compare_exchange_weak(s, 0, memory_order_acq_rel, memory_order_acquire)) {
+        return;
+      }
+    }
+
+    sem_wait(&lockWaiters); // Grab waiters lock, numWaiting cannot change while holding it
+    s = state.load(memory_order_acquire);
+    Waiter* first = waitersHead;
+    Waiter* w = waitersHead;
+    int admitted = 0;
+    while (w != nullptr && admitted < matchSize) {
+      admitted++;
+      w->place = admitted;
+      w = w->next;
+    }
+    waitersHead = w;
+    if (w == nullptr) {
+      waitersTail = nullptr;
+    }
+    // The admitted waiters already hold their places, arriving players cannot take them
+    // A plain store is enough, with the match bit still set only players holding lockWaiters change the word
+    uint64_t next = (uint64_t)(numWaiting(s) - admitted) * kWaitingUnit + (uint64_t)admitted * kPlayerUnit;
+    if (admitted == matchSize) {
+      next |= kMatchOngoing;
+    }
+    state.store(next, memory_order_release);
+    sem_post(&lockWaiters); // Release waiters lock
+
+    for (int i = 0; i < admitted; i++) {
+      Waiter* n = first->next; // Read before waking, the waiter's node goes away with its stack frame
+      sem_post(&first->wake);
+      first = n;
+    }
+  }
 
 public:
 
   Court(int courtSize, int refereePresent) {
-    if (courtSize <= 0) {
+    if (courtSize <= 0 || courtSize >= (int)kCountMask) {
       throw invalid_argument("An error occurred.");
     }
     if (refereePresent != 0 && refereePresent != 1) {
       throw invalid_argument("An error occurred.");
     }
-    numPlayers = 0;
-    numWaiting = 0;
+    state.store(0, memory_order_relaxed);
     numPlayersNeeded = courtSize;
     refereeRequired = refereePresent;
-    matchOngoing = false;
+    matchSize = refereeRequired ? numPlayersNeeded + 1 : numPlayersNeeded;
     refereeId = 0;
-    sem_init(&lockNumPlayers, 0, 1);
-    sem_init(&lockEnter, 0, 1);
-    sem_init(&lockNumWaiting, 0, 1);
-    sem_init(&lockMatchStatus, 0, 1);
-    sem_init(&waitMatchEnd, 0, 0);
-    int barrierThreshold = refereeRequired ? numPlayersNeeded + 1 : numPlayersNeeded;
-    pthread_barrier_init(&barrier, nullptr, barrierThreshold);
+    sem_init(&lockWaiters, 0, 1);
+    waitersHead = nullptr;
+    waitersTail = nullptr;
+    barrier.setThreshold(matchSize);
+    courtId = nextCourtId();
+    CourtLog::instance().log(EventConfig, courtId, pthread_self(), numPlayersNeeded, refereeRequired);
   }
 
 
   /*
     Threads call this to attempt to enter the court if it is not already full
+    A single CAS takes a place on the court, starting the match if it was the last one. While a match is ongoing
+    the thread queues instead, and only it blocks.
   */
   void enter() {
     pthread_t tid = pthread_self();
-    printf("Thread ID: %lu, I have arrived at the court.\n", (unsigned long)tid);
-
-    sem_wait(&lockEnter); // Grab enter lock to synchronize enter method body
-    sem_wait(&lockMatchStatus); // Grab match status lock to read status value
-
-    // Loop instead of single if check to allow for re-checking match status after waking up, not a busy waiting loop
-    while (matchOngoing) {
-      sem_post(&lockEnter); // Release enter lock before going to sleep to prevent deadlock 
-      sem_post(&lockMatchStatus); // Release match status lock, already read the value 
-      sem_wait(&lockNumWaiting);
-      numWaiting++; // Atomically increment waiting player count
-      sem_post(&lockNumWaiting);
-      sem_wait(&waitMatchEnd); // Wait on the semaphore until the last player signals
-      sem_wait(&lockNumWaiting);
-      numWaiting--; // Atomically decrement waiting player count after waking up
-      sem_post(&lockNumWaiting);
-      sem_wait(&lockEnter); // Re-grab enter lock to synchronize enter method body after waking up
-      sem_wait(&lockMatchStatus); // Re-grab match status lock to re-check status value after waking up
-    }
-    sem_post(&lockMatchStatus); // Release match status lock, already read the value
-
-    sem_wait(&lockNumPlayers);
-    numPlayers++; // Atomically increment player count
-    sem_post(&lockNumPlayers);
-
-    // If a referee is required and there are already enough players, make this player the referee and start the match
-    // Else if a referee is not required and there are already enough players, make this player start the match
-    // Else just print line and return from enter
-    if (refereeRequired && numPlayers == (numPlayersNeeded + 1)) {
-      sem_wait(&lockMatchStatus); // Grab match status lock to set status value
-      refereeId = tid;
-      matchOngoing = true;
-      printf("Thread ID: %lu, There are enough players, starting a match.\n", (unsigned long)tid);
-      sem_post(&lockMatchStatus); // Release match status lock after setting its value
-    }
-    else if (!refereeRequired && numPlayers == numPlayersNeeded) {
-      sem_wait(&lockMatchStatus); // Grab match status lock to set status value
-      matchOngoing = true;
-      printf("Thread ID: %lu, There are enough players, starting a match.\n", (unsigned long)tid);
-      sem_post(&lockMatchStatus); // Release match status lock after setting its value
+    CourtLog::instance().log(EventArrive, courtId, tid);
+
+    uint64_t s = state.load(memory_order_acquire);
+    int place;
+    while (true) {
+      if (matchOngoing(s)) {
+        if (waitForPlace(place)) {
+          break;
+        }
+        s = state.load(memory_order_acquire); // The match ended before this thread could queue, try again
+        continue;
+      }
+      uint64_t next = s + kPlayerUnit;
+      if (numPlayers(next) == matchSize) {
+        next |= kMatchOngoing;
+      }
+      if (state.compare_exchange_weak(s, next, memory_order_acq_rel, memory_order_acquire)) {
+        place = numPlayers(next);
+        break;
+      }
+    }
+
+    // If this player completed the court, it starts the match, and with a referee required it is the referee
+    // Else just log the player count and return from enter
+    if (place == matchSize) {
+      if (refereeRequired) {
+        refereeId = tid;
+      }
+      CourtLog::instance().log(EventStart, courtId, tid, place);
     }
     else {
-      printf("Thread ID: %lu, There are only %d players, passing some time.\n", (unsigned long)tid, numPlayers);
+      CourtLog::instance().log(EventEnter, courtId, tid, place);
     }
-
-    sem_post(&lockEnter); // Release enter lock, method complete
   }
 
   /*
@@ -113,62 +212,56 @@ public:
 
   /*
     Threads call this right after play() to leave the court
+    Returns once the thread's events are written, so whatever the caller prints after its players are joined comes last
   */
   void leave() {
     pthread_t tid = pthread_self();
 
-    sem_wait(&lockMatchStatus); // Grab match status lock to read status value
+    uint64_t s = state.load(memory_order_acquire);
     // Match hasn't started by the time play() is complete, just leave
-    if (!matchOngoing) {
-      printf("Thread ID: %lu, I was not able to find a match and I have to leave.\n", (unsigned long)tid);
-      sem_wait(&lockNumPlayers);
-      numPlayers--; // Atomically decrement player count
-      sem_post(&lockNumPlayers);
-      sem_post(&lockMatchStatus); // Release match status lock
-      return;
+    // The CAS fails if the match starts meanwhile, then this player is part of it
+    while (!matchOngoing(s)) {
+      if (state.compare_exchange_weak(s, s - kPlayerUnit, memory_order_acq_rel, memory_order_acquire)) {
+        CourtLog::instance().flushThrough(CourtLog::instance().log(EventNoMatch, courtId, tid));
+        return;
+      }
     }
-    sem_post(&lockMatchStatus); // Release match status lock, already read the value
 
-    // Match was formed, wait for the referee or the starting player to have printed "starting a match"
+    // Match was formed, wait for the referee or the starting player to have logged "starting a match"
     // This means just wait for everyone, makes up for the worst case that the referee or the starting player comes last
-    pthread_barrier_wait(&barrier);
-    // The referee or starting player should now have printed the "starting a match" line 
+    int match = barrier.wait();
+    uint64_t last;
+    // The referee or starting player should now have logged the "starting a match" event 
 
-    // If referee is required, wait for the referee to print its line
+    // If referee is required, wait for the referee to log its event
     // Else just leave in any order
     if (refereeRequired) {
       if (pthread_equal(refereeId, tid)) {
-        printf("Thread ID: %lu, I am the referee and now, match is over. I am leaving.\n", (unsigned long)tid);
-        pthread_barrier_wait(&barrier); // will print its line before the barrier is destroyed
+        last = CourtLog::instance().log(EventRefereeLeave, courtId, tid, 0, match);
+        barrier.wait(); // logs its event before the other players pass the barrier
       }
       else {
-        pthread_barrier_wait(&barrier); // will not print their line until the barrier is destroyed
-        printf("Thread ID: %lu, I am a player and now, I am leaving.\n", (unsigned long)tid);
+        barrier.wait(); // will not log their event until the referee reaches the barrier
+        last = CourtLog::instance().log(EventLeave, courtId, tid, 0, match);
       }
     }
     else {
-      printf("Thread ID: %lu, I am a player and now, I am leaving.\n", (unsigned long)tid);
-    }
-
-    sem_wait(&lockNumPlayers); // Grab num player lock to atomically set and read numPlayers
-    numPlayers--;
-    // The last player to leave ends the game and wakes up the players waiting inside the enter() method 
-    if (numPlayers == 0) {
-      sem_post(&lockNumPlayers); // Release num player lock, already set and read the value
-      sem_wait(&lockMatchStatus); // Grab match status lock to atomically read and set status value
-      printf("Thread ID: %lu, everybody left, letting any waiting people know.\n", (unsigned long)tid);
-      sem_wait(&lockNumWaiting); // Grab num waiting lock to atomically read numWaiting
-      // Wake up players waiting on the semaphore
-      for (int i = 0; i < numWaiting; i++) {
-        sem_post(&waitMatchEnd);
-      }
-      sem_post(&lockNumWaiting); // Release num waiting lock
-      matchOngoing = false;
-      sem_post(&lockMatchStatus); // Release match status lock
+      last = CourtLog::instance().log(EventLeave, courtId, tid, 0, match);
     }
-    else {
-      sem_post(&lockNumPlayers); // Release num player lock, already set and read the value
+
+    // Only match players decrement numPlayers while the match is ongoing, so whoever sees the count at one is the last
+    s = state.load(memory_order_acquire);
+    while (numPlayers(s) > 1) {
+      if (state.compare_exchange_weak(s, s - kPlayerUnit, memory_order_acq_rel, memory_order_acquire)) {
+        CourtLog::instance().flushThrough(last);
+        return;
+      }
     }
+
+    // The last player to leave ends the game and lets the players waiting inside the enter() method in
+    last = CourtLog::instance().log(EventWakeWaiters, courtId, tid, 0, match);
+    admitWaiters(s);
+    CourtLog::instance().flushThrough(last); // After admitting, the waiters need not wait for the output
   }
 
 };
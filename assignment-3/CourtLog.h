@@ -0,0 +1,167 @@
+#ifndef COURTLOG_H
+#define COURTLOG_H
+
+#include "../assignment-2/asyncLog.h"
+#include "pthread.h"
+#include <atomic>
+#include <cstdint>
+#include <queue>
+#include <vector>
+#include "stdio.h"
+#include "stdlib.h"
+
+using namespace std;
+
+
+enum CourtEventType : uint32_t {
+  EventConfig,        // court created, value = players needed, match = referee required
+  EventArrive,        // "I have arrived at the court."
+  EventWait,          // queued behind an ongoing match, not printed
+  EventEnter,         // "There are only <value> players, passing some time."
+  EventStart,         // "There are enough players, starting a match."
+  EventNoMatch,       // "I was not able to find a match and I have to leave."
+  EventRefereeLeave,  // "I am the referee and now, match is over. I am leaving."
+  EventLeave,         // "I am a player and now, I am leaving."
+  EventWakeWaiters    // "everybody left, letting any waiting people know."
+};
+
+/*
+  One court event, as written to the binary log
+  match is the barrier generation of the match for the leave and wake-waiters events
+*/
+struct CourtEvent {
+  uint64_t seq;       // position in the global order of events
+  uint64_t tid;       // thread the event happened on
+  uint32_t court;     // id of the court
+  uint32_t type;      // CourtEventType
+  int32_t value;
+  int32_t match;
+};
+
+/*
+  Asynchronous event log of the courts
+  Threads hand fixed-size records to the AsyncRecorder of assignment-2, whose background thread puts them back
+  in sequence order, prints the usual messages and, if COURT_LOG names a file, appends the raw records to it
+  for court_replay to check. Logging an event costs one fetch_add on the sequence counter and a store to
+  the thread's own ring, stdout I/O stays off the court's path.
+*/
+class CourtLog {
+
+private:
+
+  struct LaterSeq {
+    bool operator()(const CourtEvent& a, const CourtEvent& b) const {
+      return a.seq > b.seq;
+    }
+  };
+
+  atomic<uint64_t> nextSeq{0};        // sequence number of the next logged event
+  atomic<uint64_t> written{0};        // events printed so far, always a prefix of the sequence
+  priority_queue<CourtEvent, vector<CourtEvent>, LaterSeq> pending; // drained events not yet in sequence, drainer only
+  FILE* binaryLog;                    // raw records, nullptr unless COURT_LOG is set
+  AsyncRecorder<CourtEvent> recorder; // last, its drainer uses the fields above
+
+  CourtLog() : binaryLog(nullptr), recorder([this](const CourtEvent& e) { pending.push(e); }, [this]() { writePending(); }) {
+    const char* path = getenv("COURT_LOG");
+    if (path != nullptr && path[0] != '\0') {
+      binaryLog = fopen(path, "wb");
+    }
+  }
+
+  static void print(const CourtEvent& e) {
+    unsigned long tid = (unsigned long)e.tid;
+    switch (e.type) {
+      case EventArrive:
+        printf("Thread ID: %lu, I have arrived at the court.\n", tid);
+        break;
+      case EventEnter:
+        printf("Thread ID: %lu, There are only %d players, passing some time.\n", tid, e.value);
+        break;
+      case EventStart:
+        printf("Thread ID: %lu, There are enough players, starting a match.\n", tid);
+        break;
+      case EventNoMatch:
+        printf("Thread ID: %lu, I was not able to find a match and I have to leave.\n", tid);
+        break;
+      case EventRefereeLeave:
+        printf("Thread ID: %lu, I am the referee and now, match is over. I am leaving.\n", tid);
+        break;
+      case EventLeave:
+        printf("Thread ID: %lu, I am a player and now, I am leaving.\n", tid);
+        break;
+      case EventWakeWaiters:
+        printf("Thread ID: %lu, everybody left, letting any waiting people know.\n", tid);
+        break;
+      default:
+        break;
+    }
+  }
+
+  /*
+    Writes the drained events that continue the sequence, called by the drainer after each pass
+    A thread may have taken a sequence number and not stored its record yet, later events wait for it
+  */
+  void writePending() {
+    uint64_t next = written.load(memory_order_relaxed);
+    uint64_t first = next;
+    while (!pending.empty() && pending.top().seq == next) {
+      const CourtEvent& e = pending.top();
+      print(e);
+      if (binaryLog != nullptr) {
+        fwrite(&e, sizeof(CourtEvent), 1, binaryLog);
+      }
+      pending.pop();
+      next++;
+    }
+    if (next > first) {
+      fflush(stdout);
+      if (binaryLog != nullptr) {
+        fflush(binaryLog);
+      }
+      written.store(next, memory_order_release);
+    }
+  }
+
+public:
+
+  static CourtLog& instance() {
+    static CourtLog log;
+    return log;
+  }
+
+  ~CourtLog() {
+    recorder.stop(); // Every logging thread is done, the drainer writes the rest of the sequence
+    if (binaryLog != nullptr) {
+      fclose(binaryLog);
+    }
+  }
+
+  /*
+    Returns the event's sequence number
+  */
+  uint64_t log(CourtEventType type, uint32_t court, pthread_t tid, int32_t value = 0, int32_t match = 0) {
+    uint64_t seq = nextSeq.fetch_add(1, memory_order_relaxed);
+    recorder.push({seq, (uint64_t)tid, court, type, value, match});
+    return seq;
+  }
+
+  /*
+    Sleeps until the event seq and every event before it have been written
+  */
+  void flushThrough(uint64_t seq) {
+    recorder.waitUntil([this, seq]() { return written.load(memory_order_acquire) > seq; });
+  }
+
+  /*
+    Returns once every event logged before the call has been written
+  */
+  void flush() {
+    uint64_t target = nextSeq.load(memory_order_acquire);
+    if (target > 0) {
+      flushThrough(target - 1);
+    }
+  }
+
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef COURTPOOL_H
+#define COURTPOOL_H
+
+#include "Court.h"
+#include "pthread.h"
+#include "semaphore.h"
+#include <stdexcept>
+#include <vector>
+#include "stdio.h"
+
+using namespace std;
+
+
+/*
+  Set of identical courts sharing one entrance
+  Arriving players are sent to the open court closest to starting a match, so courts fill one at a time
+  instead of every court collecting a few players. Players that find every court busy wait at the pool
+  rather than at one court, and whichever court frees up first takes them in.
+*/
+class CourtPool {
+
+private:
+
+  vector<Court*> courts;       // courts managed by the pool
+  vector<int> numInside;       // players routed to each court that have not left yet
+  vector<bool> courtBusy;      // whether each court has a match and does not accept players until it is empty
+  int numWaiting;              // number of players waiting for a court to free up
+  int courtCapacity;           // players (including referee) a court takes before its match starts
+  sem_t lockPool;              // binary semaphore (lock) for atomic access to the routing state above
+  sem_t waitCourtFree;         // semaphore for players waiting for any court to free up
+
+  /*
+    Returns the open court with the most players inside, -1 if every court is busy
+    Called while holding lockPool
+  */
+  int pickCourt() {
+    int best = -1;
+    for (int i = 0; i < courts.size(); i++) {
+      if (!courtBusy[i] && (best < 0 || numInside[i] > numInside[best])) {
+        best = i;
+      }
+    }
+    return best;
+  }
+
+public:
+
+  CourtPool(int numCourts, int courtSize, int refereePresent) {
+    if (numCourts <= 0) {
+      throw invalid_argument("An error occurred.");
+    }
+    for (int i = 0; i < numCourts; i++) {
+      courts.push_back(new Court(courtSize, refereePresent)); // Validates courtSize and refereePresent
+    }
+    numInside = vector<int>(numCourts, 0);
+    courtBusy = vector<bool>(numCourts, false);
+    numWaiting = 0;
+    courtCapacity = refereePresent ? courtSize + 1 : courtSize;
+    sem_init(&lockPool, 0, 1);
+    sem_init(&waitCourtFree, 0, 0);
+  }
+
+  ~CourtPool() {
+    for (int i = 0; i < courts.size(); i++) {
+      delete courts[i];
+    }
+    sem_destroy(&lockPool);
+    sem_destroy(&waitCourtFree);
+  }
+
+  /*
+    Enters the calling thread into the open court that can start a match soonest, waiting if every court is busy
+    Returns the court, the thread then calls play() and leave() on the pool with it
+  */
+  Court* enter() {
+    sem_wait(&lockPool); // Grab pool lock to read and update the routing state
+    int chosen = pickCourt();
+    // Loop instead of single if check to allow for re-checking after waking up, another player may have taken the place
+    while (chosen < 0) {
+      numWaiting++;
+      sem_post(&lockPool); // Release pool lock before going to sleep
+      sem_wait(&waitCourtFree); // Wait until a court frees up, the waker already took this player off numWaiting
+      sem_wait(&lockPool);
+      chosen = pickCourt();
+    }
+    numInside[chosen]++;
+    // The court starts its match with this player, nobody else may be sent there until it is empty again
+    if (numInside[chosen] == courtCapacity) {
+      courtBusy[chosen] = true;
+    }
+    // Never blocks, the court has no match yet, and holding the lock keeps the court's player count in step with numInside
+    courts[chosen]->enter();
+    sem_post(&lockPool); // Release pool lock
+    return courts[chosen];
+  }
+
+  /*
+    Threads call this right after play() to leave the court enter() returned
+  */
+  void leave(Court* court) {
+    int index = 0;
+    while (courts[index] != court) {
+      index++;
+    }
+    sem_wait(&lockPool); // Grab pool lock to read and update the routing state
+    // No match on this court, leave() returns right away, doing it under the lock keeps numInside exact for routing
+    if (!courtBusy[index]) {
+      court->leave();
+      numInside[index]--;
+      sem_post(&lockPool); // Release pool lock
+      return;
+    }
+    sem_post(&lockPool); // Release pool lock before waiting for the other players of the match
+
+    court->leave();
+
+    sem_wait(&lockPool); // Re-grab pool lock to update the routing state
+    numInside[index]--;
+    // The last player of a match frees the court, wake up as many waiting players as it can take
+    if (courtBusy[index] && numInside[index] == 0) {
+      courtBusy[index] = false;
+      int wake = numWaiting < courtCapacity ? numWaiting : courtCapacity;
+      numWaiting -= wake;
+      for (int i = 0; i < wake; i++) {
+        sem_post(&waitCourtFree);
+      }
+    }
+    sem_post(&lockPool); // Release pool lock
+  }
+
+  int size() {
+    return courts.size();
+  }
+
+};
+
+#endif
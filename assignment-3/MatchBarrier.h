@@ -0,0 +1,114 @@
+#ifndef MATCHBARRIER_H
+#define MATCHBARRIER_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+/*
+  Reusable barrier for the players of a match, in user space
+  Every arriving thread takes a ticket, tickets are counted across uses, so generation n is made of tickets
+  n * threshold to (n + 1) * threshold - 1 and nothing has to be reset between matches. A thread that arrives
+  early for the next generation cannot be let through by, or overwrite the count of, the one before it.
+  The last few waiters spin for a short while if there are CPUs to run the missing players, then they sleep
+  on a futex until their generation completes.
+*/
+class MatchBarrier {
+
+private:
+
+  static const uint64_t kSpinsPerMissing = 256; // checks of the generation before sleeping, per player still missing
+
+  atomic<uint64_t> arrived;             // tickets handed out since the last setThreshold()
+  atomic<uint32_t> generation;          // number of completed generations, the futex waiters sleep on
+  atomic<uint32_t> sleepers;            // threads sleeping (or about to) on the futex
+  uint64_t threshold;                   // threads per generation
+  uint32_t baseGeneration;              // generation of ticket 0
+
+  static long futex(atomic<uint32_t>* addr, int op, uint32_t val) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, nullptr, nullptr, 0);
+  }
+
+  /*
+    Checks of the generation a thread makes before sleeping, given its ticket
+    Spinning only pays off when the players still missing are running right now, which needs a CPU each
+    besides the spinner's. The fewer are missing, the sooner the generation completes, so the early arrivals
+    of a big match go straight to sleep and only the last few spin, each for a span that grows with the gap.
+  */
+  uint64_t spinsFor(uint64_t ticket) {
+    static const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t missing = threshold - 1 - ticket % threshold;
+    return (long)missing < cpus ? missing * kSpinsPerMissing : 0;
+  }
+
+  bool passed(uint32_t gen) {
+    return (int32_t)(generation.load(memory_order_acquire) - gen) > 0;
+  }
+
+public:
+
+  MatchBarrier(int count = 1) : arrived(0), generation(0), sleepers(0), threshold(1), baseGeneration(0) {
+    setThreshold(count);
+  }
+
+  MatchBarrier(const MatchBarrier&) = delete;
+  MatchBarrier& operator=(const MatchBarrier&) = delete;
+
+  /*
+    Changes the number of threads per generation, only while no thread is inside wait()
+  */
+  void setThreshold(int count) {
+    if (count <= 0) {
+      throw invalid_argument("An error occurred.");
+    }
+    threshold = count;
+    baseGeneration = generation.load(memory_order_relaxed);
+    arrived.store(0, memory_order_relaxed);
+  }
+
+  /*
+    Blocks until threshold threads, including this one, have called wait() for the same generation
+    Returns that generation
+  */
+  uint32_t wait() {
+    uint64_t ticket = arrived.fetch_add(1, memory_order_acq_rel);
+    uint32_t gen = baseGeneration + (uint32_t)(ticket / threshold);
+
+    // The last thread of the generation completes it, unless a later generation already got further
+    if ((ticket + 1) % threshold == 0) {
+      uint32_t g = generation.load(memory_order_relaxed);
+      while ((int32_t)(gen + 1 - g) > 0 &&
+             !generation.compare_exchange_weak(g, gen + 1, memory_order_seq_cst, memory_order_relaxed)) {
+      }
+      // Pairs with the sleepers increment below: either the sleeper sees the new generation or this sees the sleeper
+      if (sleepers.load(memory_order_seq_cst) > 0) {
+        futex(&generation, FUTEX_WAKE_PRIVATE, INT_MAX);
+      }
+      return gen;
+    }
+
+    for (uint64_t i = spinsFor(ticket); i > 0 && !passed(gen); i--) {
+    }
+    if (!passed(gen)) {
+      sleepers.fetch_add(1, memory_order_seq_cst);
+      uint32_t g = generation.load(memory_order_seq_cst);
+      // Loop to absorb spurious wakeups and wakeups meant for an earlier generation
+      while ((int32_t)(g - gen) <= 0) {
+        futex(&generation, FUTEX_WAIT_PRIVATE, g);
+        g = generation.load(memory_order_acquire);
+      }
+      sleepers.fetch_sub(1, memory_order_relaxed);
+    }
+    return gen;
+  }
+
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include <semaphore.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "Court.h"
+using namespace std;
+
+/*
+  Measures the context switches a match end costs
+  Usage: ./court_bench [playerNum] [courtSize] [refereePresent] [playMicros]
+  Every player arrives at once, plays once and leaves, so all but the first match wait behind a crowd.
+  The court's own output goes to /dev/null, the CSV line with voluntary and involuntary context switches
+  of the whole process (getrusage) goes to stderr.
+*/
+
+Court* court = nullptr;
+int playMicros = 1000;
+
+void Court::play() {
+    usleep(playMicros);
+}
+
+void dummy_thread() {
+    court->enter();
+    court->play();
+    court->leave();
+}
+
+
+int main(int argc, char *argv[]){
+    int playerNum = argc > 1 ? atoi(argv[1]) : 400;
+    int courtSize = argc > 2 ? atoi(argv[2]) : 4;
+    int refereePresent = argc > 3 ? atoi(argv[3]) : 1;
+    playMicros = argc > 4 ? atoi(argv[4]) : 1000;
+    vector<pthread_t> allThreads;
+    try {
+        court = new Court(courtSize, refereePresent);
+    } catch (const std::exception& e) {
+        printf("Exception caught:  %s\n", e.what());
+        return 0;
+    }
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        return 1;
+    }
+
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for(int i=0;i<playerNum;i++){
+        pthread_t thread;
+        pthread_create(&thread,NULL,(void *(*)(void *))dummy_thread,NULL);
+        allThreads.push_back(thread);
+    }
+    for(int i=0;i<allThreads.size();i++)
+        pthread_join(allThreads[i],NULL);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    getrusage(RUSAGE_SELF, &after);
+
+    int matches = playerNum / (courtSize + refereePresent);
+    long voluntary = after.ru_nvcsw - before.ru_nvcsw;
+    long involuntary = after.ru_nivcsw - before.ru_nivcsw;
+    fprintf(stderr, "players,court_size,referee,matches,seconds,voluntary_csw,involuntary_csw,csw_per_match\n");
+    fprintf(stderr, "%d,%d,%d,%d,%.3f,%ld,%ld,%.1f\n", playerNum, courtSize, refereePresent, matches,
+        chrono::duration<double>(end - begin).count(), voluntary, involuntary,
+        matches > 0 ? (double)(voluntary + involuntary) / matches : 0.0);
+    return 0;
+}
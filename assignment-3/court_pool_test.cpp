@@ -0,0 +1,50 @@
+#include <semaphore.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include "CourtPool.h"
+using namespace std;
+
+CourtPool* pool = nullptr;
+
+void Court::play() {
+    sleep(2);
+}
+
+void dummy_thread() {
+    Court* court = pool->enter();
+    court->play();
+    pool->leave(court);
+
+}
+
+
+int main(int argc, char *argv[]){
+    int playerNum = atoi(argv[1]);
+    int courtSize = atoi(argv[2]);
+    int refereePresent = atoi(argv[3]);
+    int numCourts = atoi(argv[4]);
+    vector<pthread_t> allThreads;
+    try {
+        pool = new CourtPool(numCourts, courtSize, refereePresent);
+    } catch (const std::exception& e) {
+        // Catch all exceptions derived from std::exception
+        printf("Exception caught:  %s\n", e.what());
+        return 0;
+    }
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for(int i=0;i<playerNum;i++){
+        pthread_t thread;
+        pthread_create(&thread,NULL,(void *(*)(void *))dummy_thread,NULL);
+        allThreads.push_back(thread);
+    }
+    for(int i=0;i<allThreads.size();i++)
+        pthread_join(allThreads[i],NULL);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    printf("All players left after %.1f seconds on %d courts.\n", chrono::duration<double>(end - begin).count(), numCourts);
+    delete pool;
+    printf("The Main terminates.\n");
+    return 0;
+}
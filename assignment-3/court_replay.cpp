@@ -0,0 +1,188 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "CourtLog.h"
+using namespace std;
+
+/*
+  Checks a binary court log written with COURT_LOG=<file>
+  Usage: ./court_replay <file>
+  Replays the events in sequence order and checks that
+  - sequence numbers are complete, and every court is created before it is used
+  - each thread arrives, possibly waits, enters, then leaves, one court visit at a time
+  - a court never starts a match while one is ongoing, nor takes more than a match's players into it
+  - with a referee, the starting player is the referee and leaves before every player of its match
+  - the last player of a match wakes the waiters once all of the match's players have left
+  Prints OK with a summary, or the first broken rule and exits with 1.
+*/
+
+enum Phase { Outside, Arrived, Entered, LeftMatch };
+
+struct ThreadState {
+  Phase phase = Outside;
+  uint32_t court = 0;
+};
+
+struct CourtState {
+  int matchSize = 0;
+  bool refereeRequired = false;
+  bool ongoing = false;
+  uint64_t starter = 0;     // thread that started the ongoing match
+  int match = -1;           // barrier generation of the ongoing match, -1 until its first leave
+  int lastMatch = -1;       // generation of the previous match
+  int leaves = 0;           // players of the ongoing match that left
+  bool refereeLeft = false;
+  int matches = 0;
+};
+
+string check(const CourtEvent& e, map<uint32_t, CourtState>& courts, map<uint64_t, ThreadState>& threads) {
+  if (e.type == EventConfig) {
+    if (courts.count(e.court)) {
+      return "court created twice";
+    }
+    CourtState& c = courts[e.court];
+    c.refereeRequired = e.match != 0;
+    c.matchSize = e.value + (c.refereeRequired ? 1 : 0);
+    return "";
+  }
+  if (!courts.count(e.court)) {
+    return "event of an unknown court";
+  }
+  CourtState& c = courts[e.court];
+  ThreadState& t = threads[e.tid];
+  if (t.phase != Outside && t.phase != LeftMatch && t.court != e.court) {
+    return "thread on two courts at once";
+  }
+
+  switch (e.type) {
+    case EventArrive:
+      if (t.phase != Outside && t.phase != LeftMatch) {
+        return "arrived twice";
+      }
+      t.phase = Arrived;
+      t.court = e.court;
+      return "";
+    case EventWait:
+      return t.phase == Arrived ? "" : "waiting without arriving";
+    case EventEnter:
+      if (t.phase != Arrived) {
+        return "entered without arriving";
+      }
+      if (e.value < 1 || e.value >= c.matchSize) {
+        return "entered with an impossible player count";
+      }
+      t.phase = Entered;
+      return "";
+    case EventStart:
+      if (t.phase != Arrived) {
+        return "started a match without arriving";
+      }
+      if (c.ongoing) {
+        return "match started while another one is ongoing";
+      }
+      t.phase = Entered;
+      c.ongoing = true;
+      c.starter = e.tid;
+      c.match = -1;
+      c.leaves = 0;
+      c.refereeLeft = false;
+      return "";
+    case EventNoMatch:
+      if (t.phase != Entered) {
+        return "left without entering";
+      }
+      t.phase = Outside;
+      return "";
+    case EventRefereeLeave:
+    case EventLeave:
+      if (t.phase != Entered) {
+        return "left without entering";
+      }
+      if (!c.ongoing) {
+        return "left a match that is not ongoing";
+      }
+      if (c.match == -1) {
+        if (e.match == c.lastMatch) {
+          return "match reused the previous barrier generation";
+        }
+        c.match = e.match;
+      }
+      else if (e.match != c.match) {
+        return "players of two matches leaving at once";
+      }
+      if (e.type == EventRefereeLeave) {
+        if (!c.refereeRequired || e.tid != c.starter || c.refereeLeft) {
+          return "unexpected referee";
+        }
+        c.refereeLeft = true;
+      }
+      else if (c.refereeRequired && !c.refereeLeft) {
+        return "player left before the referee";
+      }
+      if (++c.leaves > c.matchSize) {
+        return "more players left than the match had";
+      }
+      t.phase = LeftMatch;
+      return "";
+    case EventWakeWaiters:
+      if (t.phase != LeftMatch || !c.ongoing || e.match != c.match) {
+        return "waiters woken by a thread that did not just leave the match";
+      }
+      if (c.leaves != c.matchSize) {
+        return "waiters woken before everybody left";
+      }
+      c.ongoing = false;
+      c.lastMatch = c.match;
+      c.matches++;
+      t.phase = Outside;
+      return "";
+    default:
+      return "unknown event type";
+  }
+}
+
+
+int main(int argc, char *argv[]){
+    if (argc != 2) {
+        printf("Usage: %s <log file>\n", argv[0]);
+        return 1;
+    }
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    map<uint32_t, CourtState> courts;
+    map<uint64_t, ThreadState> threads;
+    CourtEvent e;
+    uint64_t count = 0;
+    while (fread(&e, sizeof(CourtEvent), 1, file) == 1) {
+        string error = e.seq == count ? check(e, courts, threads) : "missing or reordered event";
+        if (!error.empty()) {
+            printf("Error at event %llu, thread %lu, court %u: %s\n", (unsigned long long)e.seq, (unsigned long)e.tid, e.court, error.c_str());
+            fclose(file);
+            return 1;
+        }
+        count++;
+    }
+    fclose(file);
+
+    int matches = 0;
+    for (auto& entry : courts) {
+        if (entry.second.ongoing) {
+            printf("Error: court %u ends with a match ongoing\n", entry.first);
+            return 1;
+        }
+        matches += entry.second.matches;
+    }
+    for (auto& entry : threads) {
+        if (entry.second.phase == Arrived || entry.second.phase == Entered) {
+            printf("Error: thread %lu never left court %u\n", (unsigned long)entry.first, entry.second.court);
+            return 1;
+        }
+    }
+    printf("OK: %llu events, %d matches on %d courts, %d threads\n", (unsigned long long)count, matches, (int)courts.size(), (int)threads.size());
+    return 0;
+}